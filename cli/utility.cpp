@@ -7,8 +7,10 @@
  *
  */
 
+#include <chrono>
 #include <iostream>
 #include "../inc/sm_client.hpp"
+#include "../inc/sm_fleet.hpp"
 
 const std::string interactive_text = "program started in interactive mode, type help for available commands. \n";
 const std::string error_text = "unsupported command passed, type help to see available commands. \n";
@@ -24,6 +26,7 @@ const std::string upload_text = "upload";
 const std::string erase_text = "erase";
 const std::string stop_text = "stop";
 const std::string goapp_text = "goapp";
+const std::string fleet_text = "fleet";
 
 enum class Commands
 {
@@ -38,11 +41,14 @@ enum class Commands
     disconnect,
     upload,
     erase,
-    goapp
+    goapp,
+    fleet
 };
 
 sm::ServerData server_data;
 std::string firmware_file = "NULL";
+std::string manifest_file = "NULL";
+size_t fleet_workers = 0;
 std::string port          = "NULL";
 std::uint8_t server_address = 0;
 std::vector<std::string> devices;
@@ -53,7 +59,33 @@ sp::PortConfig config;
 static void    print_devices();
 static void     print_help();
 static void     print_status();
+static void     run_fleet();
 static bool     execute_cmd(const Commands cmd);
+static void run_fleet()
+{
+    std::vector<sm::FleetJob> jobs;
+    if(!sm::Fleet::loadManifest(manifest_file, jobs) || jobs.empty())
+    {
+        std::cout<<"failed to load manifest "<<manifest_file<<"\n";
+        return;
+    }
+    sm::Fleet fleet(config);
+    const auto start_time = std::chrono::steady_clock::now();
+    const std::vector<sm::FleetResult> results = fleet.run(jobs, fleet_workers);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    size_t total_bytes = 0;
+    size_t failed = 0;
+    for(const sm::FleetResult& result : results)
+    {
+        std::printf("%s server %d : %s, %zu bytes in %.2f s \n", result.job.port.c_str(), result.job.address,
+                    result.error ? result.error.message().c_str() : "uploaded", result.uploaded_bytes, result.elapsed.count());
+        total_bytes += result.uploaded_bytes;
+        failed += result.error ? 1 : 0;
+    }
+    std::printf("fleet: %zu of %zu boards flashed, %zu bytes in %.2f s, %.1f KB/s \n", results.size() - failed, results.size(), total_bytes,
+                elapsed.count(), (total_bytes / 1024.0) / elapsed.count());
+}
+
 static Commands parse_str(const std::string& str);
 
 int main(int argc, char* argv[])
@@ -62,6 +94,8 @@ int main(int argc, char* argv[])
     //hardcoded port parameters, 57600 bd, 2s timeout
     config.baudrate = sp::PortBaudRate::BD_115200;
     config.timeout_ms = 2000;
+    //non-blocking port with event polling, ignored on Windows
+    config.io_mode = sp::PortIoMode::Event;
     
     //master chip
     client.addServer(1);
@@ -106,9 +140,11 @@ static void print_help()
             <<"stop       - stop client, close port; \n\n"
             <<"connect    - connect to server with passed id, usage example : connect 77; \n\n"
             <<"disconnect - disconnect from server; \n\n"
-            <<"upload     - upload new firmware to the server, usage example : upload firmware.bin; \n\n"
+            <<"upload     - upload new firmware to the server (.bin, .hex or .srec), usage example : upload firmware.hex; \n\n"
             <<"erase      - erase firmware from server; \n\n"
             <<"goapp      - start application on server; \n\n"
+            <<"fleet      - upload firmware to all boards of manifest at once, line format : port address gateway image,\n"
+            <<"             optional number of ports flashed at once, usage example : fleet manifest.txt 8; \n\n"
             ;
 }
 
@@ -217,6 +253,22 @@ static Commands parse_str(const std::string& str)
             cmd = Commands::upload;
         }
     }
+    if(argv[0] == fleet_text)
+    {
+        if((argv.size() == 2) || (argv.size() == 3))
+        {
+            try
+            {
+                fleet_workers = (argv.size() == 3) ? std::stoul(argv[2]) : 0;
+                manifest_file = argv[1];
+                cmd = Commands::fleet;
+            }
+            catch(const std::exception& e)
+            {
+                std::cerr << e.what() << '\n';
+            }
+        }
+    }
     if(argv[0] == start_text)
     {
         if(argv.size() == 2)
@@ -340,6 +392,10 @@ static bool execute_cmd(const Commands cmd)
         case Commands::goapp:
             client.startApp(1);
             break;
+
+        case Commands::fleet:
+            run_fleet();
+            break;
             
         case Commands::unknown:
         default:    
@@ -9,7 +9,9 @@
 #ifndef SP_LINUX_H
 #define SP_LINUX_H
 
+#include "../sp_ring_buffer.hpp"
 #include "../sp_types.hpp"
+#include <chrono>
 #include <cstdint>
 #include <errno.h>
 #include <fcntl.h>
@@ -37,19 +39,63 @@ public:
     /// @brief write raw data to actual port
     /// @param data string object with data to send
     void writeBinary(const std::vector<std::uint8_t>& data);
+    /// @brief write raw data to actual port
+    /// @param data pointer to data to send
+    /// @param length data length in bytes
+    void writeBinary(const std::uint8_t* data, size_t length);
     /// @brief read raw data from port
     /// @param data reference to vector with buffer for data
     /// @param length how many bytes we expect to read during timeout
     /// @returns how many bytes we read actually
     size_t readBinary(std::vector<std::uint8_t>& data, size_t length);
+    /// @brief read raw data from port without waiting for the whole length,
+    /// returns as soon as some data is available, port buffers are not flushed
+    /// @param data pointer to buffer for data
+    /// @param length maximum amount of bytes to read
+    /// @returns how many bytes we read actually, 0 in case of timeout
+    size_t readSome(std::uint8_t* data, size_t length);
     /// @brief reset internal OS buffers
     void flushPort();
+    /// @brief enable buffered receive mode, read calls do not flush OS
+    /// buffers and bytes received beyond requested length are kept in port
+    /// ring buffer for the next read call
+    /// @param enabled true to enable buffered mode
+    void setBufferedMode(const bool enabled);
+    bool isBufferedMode() const { return buffered; }
+    /// @brief request for amount of received bytes waiting in ring buffer
+    /// @return buffered bytes
+    size_t getBufferedSize() const { return rx_buffer.size(); }
+    /// @brief drop all received data, both buffered and pending in OS input
+    /// queue, used to recover from garbage on the line
+    void resync();
+    /// @brief set read timeout with microseconds resolution, used in
+    /// sp::PortIoMode::Event mode, blocking mode keeps 100 ms resolution
+    /// @param timeout new timeout for read calls
+    void setReadTimeout(const std::chrono::microseconds timeout) { read_timeout = timeout; }
+    /// @brief request for actual io mode
+    /// @return io mode selected by setupPort
+    sp::PortIoMode getIoMode() const { return io_mode; }
+    /// @brief request for port file descriptor, used for polling
+    /// @return opened port file descriptor, -1 if port is closed
+    int getDescriptor() const { return port_desc; }
 
 private:
     /// @brief opened port file descriptor
     int port_desc = -1;
+    /// @brief epoll instance used in event mode, waits for port and timer
+    int epoll_desc = -1;
+    /// @brief timer used for read deadline in event mode
+    int timer_desc = -1;
+    /// @brief actual io mode
+    sp::PortIoMode io_mode = sp::PortIoMode::Blocking;
+    /// @brief read timeout used in event mode
+    std::chrono::microseconds read_timeout = std::chrono::milliseconds(1000);
     /// @brief struct with port configuration
     struct termios tty = {};
+    /// @brief true if buffered receive mode is enabled
+    bool buffered = false;
+    /// @brief received bytes not consumed yet, used in buffered mode
+    sp::RingBuffer rx_buffer;
     /// @brief setup parity bits in tty struct
     /// @param parity expected parity mode
     void setParity(const sp::PortParity parity);
@@ -71,6 +117,55 @@ private:
     void savePortConfiguration();
     // \brief load default configuration to the tty struct
     void setDefaultPortConfiguration();
+    // \brief switch port descriptor between blocking and non-blocking modes
+    // \param mode expected io mode
+    void setIoMode(const sp::PortIoMode mode);
+    // \brief read data available in port, in event mode wait for it until deadline
+    // \param data pointer to buffer for data
+    // \param length maximum amount of bytes to read
+    // \param deadline time point to stop waiting at
+    // \returns how many bytes we read actually, 0 in case of timeout
+    size_t readPort(std::uint8_t* data, size_t length, std::chrono::steady_clock::time_point deadline);
+    // \brief move data available in port to ring buffer, in event mode wait for it until deadline
+    // \param deadline time point to stop waiting at
+    // \returns how many bytes were added to ring buffer, 0 in case of timeout
+    size_t fillBuffer(std::chrono::steady_clock::time_point deadline);
+    // \brief wait until port has data to read or deadline is reached
+    // \param deadline time point to stop waiting at
+    // \returns true if port has data to read
+    bool waitReadable(std::chrono::steady_clock::time_point deadline);
+    // \brief wait until data can be written to port
+    void waitWritable();
+};
+
+class SerialPortPollerLinux
+{
+public:
+    SerialPortPollerLinux();
+    ~SerialPortPollerLinux();
+    SerialPortPollerLinux(const SerialPortPollerLinux&) = delete;
+    SerialPortPollerLinux& operator=(const SerialPortPollerLinux&) = delete;
+    /// @brief add opened port to the list of polled ports
+    /// @param port port to add
+    void addPort(SerialPortLinux& port);
+    /// @brief remove port from the list of polled ports
+    /// @param port port to remove
+    void removePort(SerialPortLinux& port);
+    /// @brief wait until any of polled ports has data to read, ports with
+    /// data in ring buffer are reported immediately
+    /// @param timeout maximum time to wait
+    /// @returns reference to a vector with ports ready to read, empty in case of timeout
+    const std::vector<SerialPortLinux*>& wait(const std::chrono::microseconds timeout);
+
+private:
+    /// @brief epoll instance with all polled ports and timer
+    int epoll_desc = -1;
+    /// @brief timer used for wait timeout
+    int timer_desc = -1;
+    /// @brief all polled ports, checked for buffered data before waiting
+    std::vector<SerialPortLinux*> ports;
+    /// @brief ports ready to read after last wait call
+    std::vector<SerialPortLinux*> ready;
 };
 
 #endif // SP_LINUX_H
@@ -34,17 +34,41 @@ public:
     /// @brief write raw data to actual port
     /// @param data string object with data to send
     void writeBinary(const std::vector<std::uint8_t>& data);
+    /// @brief write raw data to actual port
+    /// @param data pointer to data to send
+    /// @param length data length in bytes
+    void writeBinary(const std::uint8_t* data, size_t length);
     /// @brief read raw data from port
     /// @param data reference to vector with buffer for data
     /// @param length how many bytes we expect to read during timeout
     /// @returns how many bytes we read actually
     size_t readBinary(std::vector<std::uint8_t>& data, size_t length);
+    /// @brief read raw data from port without waiting for the whole length,
+    /// returns as soon as some data is available, port buffers are not flushed
+    /// @param data pointer to buffer for data
+    /// @param length maximum amount of bytes to read
+    /// @returns how many bytes we read actually, 0 in case of timeout
+    size_t readSome(std::uint8_t* data, size_t length);
     /// @brief reset internal OS buffers
     void flushPort();
+    /// @brief enable buffered receive mode, read calls do not flush OS
+    /// buffers, so bytes received beyond requested length stay in driver
+    /// input queue for the next read call
+    /// @param enabled true to enable buffered mode
+    void setBufferedMode(const bool enabled) { buffered = enabled; }
+    bool isBufferedMode() const { return buffered; }
+    /// @brief request for amount of received bytes waiting in port
+    /// @return bytes in driver input queue
+    size_t getBufferedSize() const;
+    /// @brief drop all received data pending in OS input queue, used to
+    /// recover from garbage on the line
+    void resync();
 
 private:
     /// @brief opened port file descriptor
     HANDLE port_desc = INVALID_HANDLE_VALUE;
+    /// @brief true if buffered receive mode is enabled
+    bool buffered = false;
     /// @brief struct with port configuration
     DCB tty = {};
     /// @brief setup parity bits in tty struct
@@ -0,0 +1,57 @@
+/**
+ * @file sp_ring_buffer.hpp
+ *
+ * @brief byte ring buffer used for buffered port reading
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#ifndef SP_RING_BUFFER_H
+#define SP_RING_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sp
+{
+class RingBuffer
+{
+public:
+    /// @brief constructor
+    /// @param capacity buffer capacity in bytes, rounded up to power of two
+    explicit RingBuffer(size_t capacity = 4096);
+    /// @brief request for amount of stored bytes
+    /// @return stored bytes
+    size_t size() const { return head - tail; }
+    /// @brief request for amount of free space
+    /// @return free space in bytes
+    size_t space() const { return storage.size() - size(); }
+    bool empty() const { return head == tail; }
+    /// @brief drop all stored bytes
+    void clear() { head = tail = 0; }
+    /// @brief get contiguous free area to write to directly
+    /// @param length reference to save area length
+    /// @return pointer to area
+    std::uint8_t* writeArea(size_t& length);
+    /// @brief mark bytes written to the area from writeArea as stored
+    /// @param length amount of bytes written
+    void commit(size_t length) { head += length; }
+    /// @brief copy stored bytes and remove them from buffer
+    /// @param data pointer to buffer for data
+    /// @param length maximum amount of bytes to copy
+    /// @return amount of bytes copied
+    size_t pop(std::uint8_t* data, size_t length);
+
+private:
+    std::vector<std::uint8_t> storage;
+    /// @brief free running write index
+    size_t head = 0;
+    /// @brief free running read index
+    size_t tail = 0;
+    size_t mask() const { return storage.size() - 1; }
+};
+} // namespace sp
+
+#endif // SP_RING_BUFFER_H
@@ -52,6 +52,12 @@ enum class PortStopBits
     Two
 };
 
+enum class PortIoMode
+{
+    Blocking, // blocking reads, timeout with 100 ms resolution, up to 25.5 s
+    Event     // non-blocking port, waiting with event polling (Linux only)
+};
+
 struct PortConfig
 {
     PortBaudRate baudrate = PortBaudRate::BD_9600;
@@ -59,6 +65,7 @@ struct PortConfig
     PortParity parity = PortParity::None;
     PortStopBits stop_bits = PortStopBits::One;
     int timeout_ms = 1000;
+    PortIoMode io_mode = PortIoMode::Blocking;
 };
 } // namespace sp
 
@@ -9,7 +9,58 @@
 
 #include "../inc/platform/sp_linux.hpp"
 #include "../inc/sp_error.hpp"
+#include <algorithm>
 #include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+namespace
+{
+/// @brief arm timer to expire at absolute deadline, steady_clock is CLOCK_MONOTONIC
+void armTimer(int timer_desc, std::chrono::steady_clock::time_point deadline)
+{
+    auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch());
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = since_epoch.count() / 1000000000;
+    spec.it_value.tv_nsec = since_epoch.count() % 1000000000;
+    if ((spec.it_value.tv_sec == 0) && (spec.it_value.tv_nsec == 0))
+    {
+        spec.it_value.tv_nsec = 1; // zero value disarms timer
+    }
+    if (timerfd_settime(timer_desc, TFD_TIMER_ABSTIME, &spec, nullptr) != 0)
+    {
+        throw std::system_error(sp::make_error_code(errno));
+    }
+}
+
+/// @brief disarm timer and drop pending expirations
+void disarmTimer(int timer_desc)
+{
+    struct itimerspec spec = {};
+    std::uint64_t expirations = 0;
+    (void)timerfd_settime(timer_desc, 0, &spec, nullptr);
+    (void)read(timer_desc, &expirations, sizeof(expirations));
+}
+
+/// @brief create non-blocking monotonic timer and epoll instance watching it
+void createEventDescriptors(int& epoll_desc, int& timer_desc, void* timer_tag)
+{
+    epoll_desc = epoll_create1(EPOLL_CLOEXEC);
+    timer_desc = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if ((epoll_desc < 0) || (timer_desc < 0))
+    {
+        throw std::system_error(sp::make_error_code(errno));
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = timer_tag;
+    if (epoll_ctl(epoll_desc, EPOLL_CTL_ADD, timer_desc, &event) != 0)
+    {
+        throw std::system_error(sp::make_error_code(errno));
+    }
+}
+} // namespace
 
 void SerialPortLinux::openPort(const std::string& path)
 {
@@ -25,13 +76,35 @@ void SerialPortLinux::closePort(void)
 {
     close(port_desc);
     port_desc = -1;
+    if (epoll_desc >= 0)
+    {
+        close(epoll_desc);
+        close(timer_desc);
+        epoll_desc = -1;
+        timer_desc = -1;
+    }
+    io_mode = sp::PortIoMode::Blocking;
+    rx_buffer.clear();
 }
 
 void SerialPortLinux::flushPort()
 {
+    rx_buffer.clear();
     tcflush(port_desc, TCIOFLUSH);
 }
 
+void SerialPortLinux::setBufferedMode(const bool enabled)
+{
+    buffered = enabled;
+    rx_buffer.clear();
+}
+
+void SerialPortLinux::resync()
+{
+    rx_buffer.clear();
+    tcflush(port_desc, TCIFLUSH);
+}
+
 void SerialPortLinux::setupPort(const sp::PortConfig& config)
 {
     loadPortConfiguration();
@@ -40,56 +113,213 @@ void SerialPortLinux::setupPort(const sp::PortConfig& config)
     setDataBits(config.data_bits);
     setParity(config.parity);
     setStopBits(config.stop_bits);
+    setIoMode(config.io_mode);
     setTimeOut(config.timeout_ms);
     savePortConfiguration();
 }
 
 void SerialPortLinux::writeString(const std::string& data)
 {
-    int stat = write(port_desc, data.c_str(), data.size());
-    if (stat == -1)
-    {
-        throw std::system_error(sp::make_error_code(errno));
-    }
+    writeBinary(reinterpret_cast<const std::uint8_t*>(data.c_str()), data.size());
 }
 
 void SerialPortLinux::writeBinary(const std::vector<std::uint8_t>& data)
 {
-    int stat = write(port_desc, data.data(), data.size());
-    if (stat == -1)
+    writeBinary(data.data(), data.size());
+}
+
+void SerialPortLinux::writeBinary(const std::uint8_t* data, size_t length)
+{
+    size_t bytes_written = 0;
+    while (bytes_written < length)
     {
-        throw std::system_error(sp::make_error_code(errno));
+        ssize_t stat = write(port_desc, data + bytes_written, length - bytes_written);
+        if (stat >= 0)
+        {
+            bytes_written += stat;
+        }
+        else if ((errno == EAGAIN) && (io_mode == sp::PortIoMode::Event))
+        {
+            waitWritable();
+        }
+        else if (errno != EINTR)
+        {
+            throw std::system_error(sp::make_error_code(errno));
+        }
     }
 }
 
 size_t SerialPortLinux::readBinary(std::vector<std::uint8_t>& data,
                                    size_t length)
 {
-    ssize_t bytes_to_read = length;
+    // in event mode timeout is applied to the whole call
+    const auto deadline = std::chrono::steady_clock::now() + read_timeout;
+    size_t bytes_to_read = length;
     size_t bytes_read = 0;
     data.resize(length);
     while (bytes_to_read != 0)
     {
-        ssize_t n = read(port_desc, data.data() + bytes_read, bytes_to_read);
-        if (n < 0)
+        size_t n = 0;
+        if (buffered)
         {
-            throw std::system_error(sp::make_error_code(errno));
+            if (rx_buffer.empty() && (fillBuffer(deadline) == 0))
+            {
+                break;
+            } // nothing to read
+            n = rx_buffer.pop(data.data() + bytes_read, bytes_to_read);
         }
-        else if ((n > 0) && (n <= bytes_to_read)) // reading
+        else
         {
-            bytes_to_read = bytes_to_read - n;
-            bytes_read = bytes_read + n;
+            n = readPort(data.data() + bytes_read, bytes_to_read, deadline);
+            if (n == 0)
+            {
+                break;
+            } // nothing to read
         }
-        else if (n == 0)
-        {
-            break;
-        } // nothing to read
+        bytes_to_read = bytes_to_read - n;
+        bytes_read = bytes_read + n;
     }
     data.resize(bytes_read);
-    tcflush(port_desc, TCIOFLUSH);
+    if (!buffered)
+    {
+        tcflush(port_desc, TCIOFLUSH);
+    }
     return bytes_read;
 }
 
+size_t SerialPortLinux::readSome(std::uint8_t* data, size_t length)
+{
+    const auto deadline = std::chrono::steady_clock::now() + read_timeout;
+    if (!buffered)
+    {
+        return readPort(data, length, deadline);
+    }
+    if (rx_buffer.empty() && (fillBuffer(deadline) == 0))
+    {
+        return 0;
+    }
+    return rx_buffer.pop(data, length);
+}
+
+size_t SerialPortLinux::fillBuffer(std::chrono::steady_clock::time_point deadline)
+{
+    size_t area_size = 0;
+    std::uint8_t* area = rx_buffer.writeArea(area_size);
+    if (area_size == 0)
+    {
+        return 0;
+    }
+    size_t n = readPort(area, area_size, deadline);
+    rx_buffer.commit(n);
+    return n;
+}
+
+size_t SerialPortLinux::readPort(std::uint8_t* data, size_t length, std::chrono::steady_clock::time_point deadline)
+{
+    for (;;)
+    {
+        ssize_t n = read(port_desc, data, length);
+        if (n > 0)
+        {
+            return n;
+        }
+        if ((n < 0) && (errno != EAGAIN) && (errno != EINTR))
+        {
+            throw std::system_error(sp::make_error_code(errno));
+        }
+        if (io_mode == sp::PortIoMode::Blocking)
+        {
+            if (n == 0)
+            {
+                return 0; // VTIME expired
+            }
+        }
+        else if ((std::chrono::steady_clock::now() >= deadline) || !waitReadable(deadline))
+        {
+            return 0;
+        }
+    }
+}
+
+bool SerialPortLinux::waitReadable(std::chrono::steady_clock::time_point deadline)
+{
+    struct epoll_event events[2];
+    bool readable = false;
+    bool expired = false;
+    armTimer(timer_desc, deadline);
+    while (!readable && !expired)
+    {
+        int n = epoll_wait(epoll_desc, events, 2, -1);
+        if ((n < 0) && (errno != EINTR))
+        {
+            throw std::system_error(sp::make_error_code(errno));
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            if (events[i].data.ptr == this)
+            {
+                readable = true;
+            }
+            else
+            {
+                expired = true;
+            }
+        }
+    }
+    disarmTimer(timer_desc);
+    return readable;
+}
+
+void SerialPortLinux::waitWritable()
+{
+    struct pollfd desc = {};
+    desc.fd = port_desc;
+    desc.events = POLLOUT;
+    const int timeout_ms = std::chrono::duration_cast<std::chrono::milliseconds>(read_timeout).count();
+    int n = poll(&desc, 1, timeout_ms);
+    if (n == 0)
+    {
+        throw std::system_error(sp::make_error_code(ETIMEDOUT));
+    }
+    else if ((n < 0) && (errno != EINTR))
+    {
+        throw std::system_error(sp::make_error_code(errno));
+    }
+}
+
+void SerialPortLinux::setIoMode(const sp::PortIoMode mode)
+{
+    int flags = fcntl(port_desc, F_GETFL);
+    if (flags < 0)
+    {
+        throw std::system_error(sp::make_error_code(errno));
+    }
+    if (mode == sp::PortIoMode::Event)
+    {
+        if (epoll_desc < 0)
+        {
+            createEventDescriptors(epoll_desc, timer_desc, nullptr);
+            struct epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.ptr = this;
+            if (epoll_ctl(epoll_desc, EPOLL_CTL_ADD, port_desc, &event) != 0)
+            {
+                throw std::system_error(sp::make_error_code(errno));
+            }
+        }
+        flags |= O_NONBLOCK;
+    }
+    else
+    {
+        flags &= ~O_NONBLOCK;
+    }
+    if (fcntl(port_desc, F_SETFL, flags) != 0)
+    {
+        throw std::system_error(sp::make_error_code(errno));
+    }
+    io_mode = mode;
+}
+
 void SerialPortLinux::setParity(const sp::PortParity parity)
 {
     switch (parity)
@@ -195,6 +425,13 @@ void SerialPortLinux::setTimeOut(const int timeout_ms)
 {
     const unsigned char max_timeout = 0xFF;
     tty.c_cc[VMIN] = 0;
+    read_timeout = std::chrono::milliseconds(timeout_ms);
+    if (io_mode == sp::PortIoMode::Event)
+    {
+        // read calls return immediately, waiting is done with epoll
+        tty.c_cc[VTIME] = 0;
+        return;
+    }
     int timeout = timeout_ms / 100;
     if (timeout > max_timeout)
     {
@@ -243,3 +480,73 @@ void SerialPortLinux::setDefaultPortConfiguration()
     tty.c_oflag &= ~OPOST;
     tty.c_oflag &= ~ONLCR;
 }
+
+SerialPortPollerLinux::SerialPortPollerLinux()
+{
+    createEventDescriptors(epoll_desc, timer_desc, this);
+}
+
+SerialPortPollerLinux::~SerialPortPollerLinux()
+{
+    close(epoll_desc);
+    close(timer_desc);
+}
+
+void SerialPortPollerLinux::addPort(SerialPortLinux& port)
+{
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = &port;
+    if (epoll_ctl(epoll_desc, EPOLL_CTL_ADD, port.getDescriptor(), &event) != 0)
+    {
+        throw std::system_error(sp::make_error_code(errno));
+    }
+    ports.push_back(&port);
+}
+
+void SerialPortPollerLinux::removePort(SerialPortLinux& port)
+{
+    (void)epoll_ctl(epoll_desc, EPOLL_CTL_DEL, port.getDescriptor(), nullptr);
+    ports.erase(std::remove(ports.begin(), ports.end(), &port), ports.end());
+}
+
+const std::vector<SerialPortLinux*>& SerialPortPollerLinux::wait(const std::chrono::microseconds timeout)
+{
+    const int max_events = 16;
+    struct epoll_event events[max_events];
+    bool expired = false;
+    ready.clear();
+    for (auto port : ports)
+    {
+        if (port->getBufferedSize() != 0)
+        {
+            ready.push_back(port);
+        }
+    }
+    if (!ready.empty())
+    {
+        return ready;
+    }
+    armTimer(timer_desc, std::chrono::steady_clock::now() + timeout);
+    while (ready.empty() && !expired)
+    {
+        int n = epoll_wait(epoll_desc, events, max_events, -1);
+        if ((n < 0) && (errno != EINTR))
+        {
+            throw std::system_error(sp::make_error_code(errno));
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            if (events[i].data.ptr == this)
+            {
+                expired = true;
+            }
+            else
+            {
+                ready.push_back(static_cast<SerialPortLinux*>(events[i].data.ptr));
+            }
+        }
+    }
+    disarmTimer(timer_desc);
+    return ready;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file sp_ring_buffer.cpp
+ *
+ * @brief implementation for class defined in sp_ring_buffer.hpp
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include "../inc/sp_ring_buffer.hpp"
+#include <algorithm>
+#include <cstring>
+
+using namespace sp;
+
+RingBuffer::RingBuffer(size_t capacity)
+{
+    size_t actual_capacity = 1;
+    while (actual_capacity < capacity)
+    {
+        actual_capacity <<= 1;
+    }
+    storage.resize(actual_capacity);
+}
+
+std::uint8_t* RingBuffer::writeArea(size_t& length)
+{
+    const size_t position = head & mask();
+    length = std::min(space(), storage.size() - position);
+    return storage.data() + position;
+}
+
+size_t RingBuffer::pop(std::uint8_t* data, size_t length)
+{
+    size_t copied = 0;
+    length = std::min(length, size());
+    while (copied < length)
+    {
+        const size_t position = tail & mask();
+        const size_t chunk = std::min(length - copied, storage.size() - position);
+        std::memcpy(data + copied, storage.data() + position, chunk);
+        tail += chunk;
+        copied += chunk;
+    }
+    return copied;
+}
@@ -37,6 +37,22 @@ void SerialPortWindows::flushPort()
     FlushFileBuffers(port_desc);
 }
 
+size_t SerialPortWindows::getBufferedSize() const
+{
+    COMSTAT status = {};
+    DWORD errors = 0;
+    if (ClearCommError(port_desc, &errors, &status) == 0)
+    {
+        return 0;
+    }
+    return status.cbInQue;
+}
+
+void SerialPortWindows::resync()
+{
+    PurgeComm(port_desc, PURGE_RXABORT | PURGE_RXCLEAR);
+}
+
 void SerialPortWindows::setupPort(const sp::PortConfig& config)
 {
     loadPortConfiguration();
@@ -60,10 +76,15 @@ void SerialPortWindows::writeString(const std::string& data)
 }
 
 void SerialPortWindows::writeBinary(const std::vector<std::uint8_t>& data)
+{
+    writeBinary(data.data(), data.size());
+}
+
+void SerialPortWindows::writeBinary(const std::uint8_t* data, size_t length)
 {
     DWORD bytes_written;
     WINBOOL stat =
-        WriteFile(port_desc, data.data(), data.size(), &bytes_written, NULL);
+        WriteFile(port_desc, data, length, &bytes_written, NULL);
     if (stat == 0)
     {
         throw std::system_error(sp::make_error_code(GetLastError()));
@@ -94,7 +115,21 @@ size_t SerialPortWindows::readBinary(std::vector<std::uint8_t>& data,
         } // nothing to read
     }
     data.resize(bytes_read);
-    FlushFileBuffers(port_desc);
+    if (!buffered)
+    {
+        FlushFileBuffers(port_desc);
+    }
+    return bytes_read;
+}
+
+size_t SerialPortWindows::readSome(std::uint8_t* data, size_t length)
+{
+    DWORD bytes_read = 0;
+    WINBOOL n = ReadFile(port_desc, data, length, &bytes_read, NULL);
+    if (n == 0)
+    {
+        throw std::system_error(sp::make_error_code(GetLastError()));
+    }
     return bytes_read;
 }
 
@@ -0,0 +1,171 @@
+/**
+ * @file sm_ascii_bench.cpp
+ *
+ * @brief Modbus ASCII framing against RTU: write file records encoding and
+ * parsing with every hex engine, hex conversion and LRC throughput
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include "../inc/sm_hex.hpp"
+#include "../inc/sm_modbus.hpp"
+#include "sm_bench.hpp"
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+//////////////////////////////////BENCH CONSTANTS///////////////////////////////
+constexpr int frame_iterations = 200000;
+constexpr int block_iterations = 2000000;
+constexpr size_t record_size = 64;
+constexpr size_t records_per_frame = 3;
+constexpr size_t block_size = 255; // the longest address and PDU
+constexpr std::uint8_t server_addr = 7;
+constexpr std::uint16_t file_id = 2;
+////////////////////////////////////////////////////////////////////////////////
+
+struct Framing
+{
+    const char* name;
+    modbus::ModbusMode mode;
+    modbus::HexEngine engine;
+};
+
+const Framing framings[] = {{"rtu", modbus::ModbusMode::rtu, modbus::HexEngine::scalar},
+                            {"ascii scalar", modbus::ModbusMode::ascii, modbus::HexEngine::scalar},
+                            {"ascii sse2", modbus::ModbusMode::ascii, modbus::HexEngine::sse2},
+                            {"ascii avx2", modbus::ModbusMode::ascii, modbus::HexEngine::avx2}};
+
+const char* getName(const modbus::HexEngine engine)
+{
+    switch (engine)
+    {
+        case modbus::HexEngine::scalar:
+            return "scalar";
+        case modbus::HexEngine::sse2:
+            return "sse2";
+        case modbus::HexEngine::avx2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+/// @brief LRC as a plain loop over bytes
+std::uint8_t sumLrc(const std::uint8_t* data, const size_t length)
+{
+    std::uint8_t sum = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        sum = static_cast<std::uint8_t>(sum + data[i]);
+    }
+    return static_cast<std::uint8_t>(-sum);
+}
+} // namespace
+
+int main()
+{
+    std::vector<std::uint8_t> image(record_size * records_per_frame);
+    for (size_t i = 0; i < image.size(); ++i)
+    {
+        image[i] = static_cast<std::uint8_t>(i * 37 + 11);
+    }
+    modbus::FileRecord records[records_per_frame];
+    for (size_t i = 0; i < records_per_frame; ++i)
+    {
+        records[i] = {file_id, static_cast<std::uint16_t>(i + 5), image.data() + record_size * i, record_size};
+    }
+
+    std::printf("write file record request, %zu records of %zu bytes, %d frames, ns per frame\n\n", records_per_frame, record_size,
+                frame_iterations);
+    std::printf("framing        adu     encode   parse and check\n");
+    for (const auto& framing : framings)
+    {
+        if (!modbus::setHexEngine(framing.engine))
+        {
+            std::printf("%-12s   not supported\n", framing.name);
+            continue;
+        }
+        modbus::ModbusClient encoder;
+        encoder.setMode(framing.mode);
+        encoder.setRtuPadding(false);
+        modbus::Frame frame;
+        const size_t adu_size = encoder.encodeWriteFileRecords(frame, server_addr, records, records_per_frame);
+        modbus::FrameParser parser;
+        parser.reset(framing.mode, false, modbus::FrameDirection::request);
+        parser.push(frame.data(), adu_size);
+        if ((parser.getStatus() != modbus::ParserStatus::complete) || !parser.isChecksumValid())
+        {
+            std::printf("%s frame is not parsed back\n", framing.name);
+            return 1;
+        }
+
+        const double encoded = bench::measureNs(frame_iterations,
+                                                [&](const int i)
+                                                {
+                                                    return encoder.encodeWriteFileRecords(frame, static_cast<std::uint8_t>(i | 1), records,
+                                                                                          records_per_frame);
+                                                });
+        // the address is not changed, the same frame is parsed every time
+        encoder.encodeWriteFileRecords(frame, server_addr, records, records_per_frame);
+        const double parsed = bench::measureNs(frame_iterations,
+                                               [&](const int)
+                                               {
+                                                   parser.reset(framing.mode, false, modbus::FrameDirection::request);
+                                                   parser.push(frame.data(), adu_size);
+                                                   return static_cast<size_t>(parser.isChecksumValid());
+                                               });
+        std::printf("%-12s   %3zu B   %6.1f   %15.1f\n", framing.name, adu_size, encoded, parsed);
+    }
+
+    std::vector<std::uint8_t> block(block_size);
+    std::vector<std::uint8_t> hex(2 * block_size);
+    for (size_t i = 0; i < block.size(); ++i)
+    {
+        block[i] = static_cast<std::uint8_t>(i * 7 + 3);
+    }
+    std::printf("\n%zu bytes, %d blocks, ns per block\n\n", block_size, block_iterations);
+    std::printf("engine   hex encode   hex decode\n");
+    for (const auto engine : {modbus::HexEngine::scalar, modbus::HexEngine::sse2, modbus::HexEngine::avx2})
+    {
+        if (!modbus::isHexEngineSupported(engine))
+        {
+            std::printf("%-6s   not supported\n", getName(engine));
+            continue;
+        }
+        const double encoded = bench::measureNs(block_iterations,
+                                                [&](const int i)
+                                                {
+                                                    block[0] = static_cast<std::uint8_t>(i);
+                                                    modbus::hexEncode(engine, block.data(), block.size(), hex.data());
+                                                    return static_cast<size_t>(hex[1]);
+                                                });
+        const double decoded = bench::measureNs(block_iterations,
+                                                [&](const int i)
+                                                {
+                                                    hex[1] = static_cast<std::uint8_t>('0' + (i & 7));
+                                                    return static_cast<size_t>(modbus::hexDecode(engine, hex.data(), block.size(), block.data()));
+                                                });
+        std::printf("%-6s   %10.1f   %10.1f\n", getName(engine), encoded, decoded);
+    }
+    if (modbus::calcLrc(block.data(), block.size()) != sumLrc(block.data(), block.size()))
+    {
+        std::printf("calcLrc differs from sum of bytes\n");
+        return 1;
+    }
+    const double lrc_sum = bench::measureNs(block_iterations,
+                                            [&](const int i)
+                                            {
+                                                block[0] = static_cast<std::uint8_t>(i);
+                                                return static_cast<size_t>(sumLrc(block.data(), block.size()));
+                                            });
+    const double lrc = bench::measureNs(block_iterations,
+                                        [&](const int i)
+                                        {
+                                            block[0] = static_cast<std::uint8_t>(i);
+                                            return static_cast<size_t>(modbus::calcLrc(block.data(), block.size()));
+                                        });
+    std::printf("\nLRC      byte loop %.1f   calcLrc %.1f\n", lrc_sum, lrc);
+    return 0;
+}
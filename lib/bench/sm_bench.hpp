@@ -0,0 +1,40 @@
+/**
+ * @file sm_bench.hpp
+ *
+ * @brief timing helpers shared by sm-client benchmarks
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#ifndef SM_BENCH_H
+#define SM_BENCH_H
+
+#include <chrono>
+#include <cstddef>
+
+namespace bench
+{
+/// @brief result of measured function, kept to prevent dead code elimination
+inline volatile size_t sink = 0;
+
+/// @brief run function in a loop and measure average time of one iteration
+/// @param iterations amount of iterations
+/// @param function callable taking iteration index and returning size_t
+/// @return average time in nanoseconds
+template <typename Function>
+double measureNs(const int iterations, Function function)
+{
+    size_t result = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        result += function(i);
+    }
+    const auto stop = std::chrono::steady_clock::now();
+    sink = sink + result;
+    return std::chrono::duration<double, std::nano>(stop - start).count() / iterations;
+}
+} // namespace bench
+
+#endif // SM_BENCH_H
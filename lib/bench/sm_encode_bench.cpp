@@ -0,0 +1,101 @@
+/**
+ * @file sm_encode_bench.cpp
+ *
+ * @brief write file record encoding: vector based message builder, as it was
+ * before the frame encoder, against encoding into modbus::Frame
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include "../inc/sm_crc.hpp"
+#include "../inc/sm_modbus.hpp"
+#include "sm_bench.hpp"
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+//////////////////////////////////BENCH CONSTANTS///////////////////////////////
+constexpr int iterations = 1000000;
+constexpr size_t record_sizes[] = {16, 64, 128, 240};
+constexpr std::uint8_t server_addr = 2;
+constexpr std::uint16_t file_id = 1;
+constexpr std::uint8_t file_reference_type = 0x06;
+////////////////////////////////////////////////////////////////////////////////
+
+void insertHalfWord(std::vector<std::uint8_t>& arr, const std::uint16_t value)
+{
+    arr.push_back((value >> 8) & 0xFF);
+    arr.push_back(value & 0xFF);
+}
+
+/// @brief RTU message builder with temporary vectors and front insertion,
+/// record is copied out of the image first as the client did
+/// @param crc_engine engine used for crc, bitwise was the only one
+void legacyWriteFileRecord(std::vector<std::uint8_t>& buffer, const std::uint16_t record_id, const std::uint8_t* image, const size_t length,
+                           const modbus::CrcEngine crc_engine)
+{
+    const std::uint8_t rtu_start_end[] = {0x00, 0x00, 0x00, 0x00};
+    std::vector<std::uint8_t> record_data(image, image + length);
+    std::vector<std::uint8_t> record;
+    record.insert(record.end(), {static_cast<std::uint8_t>(length + 7), file_reference_type});
+    insertHalfWord(record, file_id);
+    insertHalfWord(record, record_id);
+    insertHalfWord(record, static_cast<std::uint16_t>(length / 2));
+    record.insert(record.end(), record_data.begin(), record_data.end());
+
+    buffer.clear();
+    buffer.insert(buffer.end(), {server_addr, static_cast<std::uint8_t>(modbus::FunctionCodes::write_file)});
+    buffer.insert(buffer.end(), record.begin(), record.end());
+    insertHalfWord(buffer, modbus::crc16(crc_engine, buffer.data(), buffer.size()));
+    buffer.insert(buffer.begin(), rtu_start_end, rtu_start_end + sizeof(rtu_start_end));
+    buffer.insert(buffer.end(), rtu_start_end, rtu_start_end + sizeof(rtu_start_end));
+}
+} // namespace
+
+int main()
+{
+    std::vector<std::uint8_t> image(256);
+    for (size_t i = 0; i < image.size(); ++i)
+    {
+        image[i] = static_cast<std::uint8_t>(i * 7 + 3);
+    }
+    modbus::ModbusClient encoder;
+    modbus::Frame frame;
+    std::vector<std::uint8_t> legacy;
+
+    std::printf("RTU write file record, %d frames, ns per frame\n\n", iterations);
+    std::printf("record   legacy(bitwise crc)   legacy(actual crc)   encoder\n");
+    for (const size_t length : record_sizes)
+    {
+        // the same bytes are sent either way
+        legacyWriteFileRecord(legacy, 1, image.data(), length, modbus::getCrcEngine());
+        encoder.encodeWriteFileRecord(frame, server_addr, file_id, 1, image.data(), length);
+        if (std::vector<std::uint8_t>(frame.begin(), frame.end()) != legacy)
+        {
+            std::printf("encoder output differs from legacy builder\n");
+            return 1;
+        }
+
+        const double legacy_bitwise = bench::measureNs(iterations,
+                                                       [&](const int i)
+                                                       {
+                                                           legacyWriteFileRecord(legacy, static_cast<std::uint16_t>(i), image.data(), length,
+                                                                                 modbus::CrcEngine::bitwise);
+                                                           return legacy.size();
+                                                       });
+        const double legacy_fast = bench::measureNs(iterations,
+                                                    [&](const int i)
+                                                    {
+                                                        legacyWriteFileRecord(legacy, static_cast<std::uint16_t>(i), image.data(), length,
+                                                                              modbus::getCrcEngine());
+                                                        return legacy.size();
+                                                    });
+        const double encoded = bench::measureNs(
+            iterations, [&](const int i)
+            { return encoder.encodeWriteFileRecord(frame, server_addr, file_id, static_cast<std::uint16_t>(i), image.data(), length); });
+        std::printf("%4zu B   %19.1f   %18.1f   %7.1f\n", length, legacy_bitwise, legacy_fast, encoded);
+    }
+    return 0;
+}
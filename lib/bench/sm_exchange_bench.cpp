@@ -0,0 +1,183 @@
+/**
+ * @file sm_exchange_bench.cpp
+ *
+ * @brief single register write exchanges against an echo server on a pty:
+ * exchanges per second, client CPU time per exchange and time from the
+ * response to the return of the task call
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include "../inc/sm_client.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+//////////////////////////////////BENCH CONSTANTS///////////////////////////////
+constexpr std::uint8_t server_addr = 1;
+constexpr int default_exchanges = 500;
+constexpr int default_delay_ms = 2;
+constexpr size_t request_size = 8; // address, function, register, value, crc
+constexpr int poll_period_ms = 50;
+////////////////////////////////////////////////////////////////////////////////
+
+/// @brief server side of the pty, every write register request is sent back
+/// after the delay as the server does on success
+class EchoServer
+{
+public:
+    ~EchoServer() { stop(); }
+    bool start(const int delay_ms)
+    {
+        master = posix_openpt(O_RDWR | O_NOCTTY);
+        if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0))
+        {
+            return false;
+        }
+        // line discipline must pass binary frames as they are
+        slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+        if (slave < 0)
+        {
+            return false;
+        }
+        termios tty = {};
+        tcgetattr(slave, &tty);
+        cfmakeraw(&tty);
+        tcsetattr(slave, TCSANOW, &tty);
+        delay = std::chrono::milliseconds(delay_ms);
+        server_thread = std::thread(&EchoServer::run, this);
+        return true;
+    }
+    void stop()
+    {
+        running = false;
+        if (server_thread.joinable())
+        {
+            server_thread.join();
+        }
+        if (slave >= 0)
+        {
+            close(slave);
+            slave = -1;
+        }
+        if (master >= 0)
+        {
+            close(master);
+            master = -1;
+        }
+    }
+    /// @brief device name as the client takes it, without /dev/ prefix
+    std::string getDevice() const { return std::string(ptsname(master)).substr(std::strlen("/dev/")); }
+
+private:
+    void run()
+    {
+        std::uint8_t request[request_size];
+        size_t received = 0;
+        pollfd desc = {master, POLLIN, 0};
+        while (running)
+        {
+            std::uint8_t value;
+            if ((poll(&desc, 1, poll_period_ms) <= 0) || (read(master, &value, 1) != 1))
+            {
+                continue;
+            }
+            // RTU padding is skipped, server address is never 0
+            if ((received == 0) && (value == 0))
+            {
+                continue;
+            }
+            request[received++] = value;
+            if (received == request_size)
+            {
+                std::this_thread::sleep_for(delay);
+                if (write(master, request, request_size) != static_cast<ssize_t>(request_size))
+                {
+                    running = false;
+                }
+                received = 0;
+            }
+        }
+    }
+    int master = -1;
+    int slave = -1;
+    std::chrono::milliseconds delay{0};
+    std::atomic<bool> running{true};
+    std::thread server_thread;
+};
+
+double getCpuSeconds()
+{
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    int exchanges = default_exchanges;
+    int delay_ms = default_delay_ms;
+    int option;
+    while ((option = getopt(argc, argv, "n:d:")) != -1)
+    {
+        switch (option)
+        {
+            case 'n':
+                exchanges = std::atoi(optarg);
+                break;
+
+            case 'd':
+                delay_ms = std::atoi(optarg);
+                break;
+
+            default:
+                std::fprintf(stderr, "usage: %s [-n exchanges] [-d server delay ms]\n", argv[0]);
+                std::fprintf(stderr, "results go to stderr, client prints progress to stdout\n");
+                return EXIT_FAILURE;
+        }
+    }
+
+    EchoServer server;
+    if (!server.start(delay_ms))
+    {
+        std::fprintf(stderr, "pty is not available\n");
+        return EXIT_FAILURE;
+    }
+    sm::Client client;
+    client.addServer(server_addr);
+    if (client.start(server.getDevice()))
+    {
+        std::fprintf(stderr, "can not open %s\n", server.getDevice().c_str());
+        return EXIT_FAILURE;
+    }
+
+    int failed = 0;
+    const double cpu_start = getCpuSeconds();
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < exchanges; ++i)
+    {
+        failed += client.startApp(server_addr) ? 1 : 0;
+    }
+    const auto stop = std::chrono::steady_clock::now();
+    const double cpu = getCpuSeconds() - cpu_start;
+    client.stop();
+
+    const double wall_ms = std::chrono::duration<double, std::milli>(stop - start).count() / exchanges;
+    std::fprintf(stderr, "%-10s %10s %12s %12s %14s %8s\n", "exchanges", "exch/s", "wall ms", "cpu ms", "completion ms", "failed");
+    std::fprintf(stderr, "%-10d %10.1f %12.3f %12.3f %14.3f %8d\n", exchanges, 1e3 / wall_ms, wall_ms, cpu * 1e3 / exchanges, wall_ms - delay_ms,
+                 failed);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -11,14 +11,21 @@
 #define SM_CLIENT_H
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <thread>
 
 #include "../../external/simple-serial-port-1.03/lib/inc/serial_port.hpp"
 #include "../inc/sm_error.hpp"
 #include "../inc/sm_file.hpp"
+#include "../inc/sm_frame_cache.hpp"
+#include "../inc/sm_journal.hpp"
 #include "../inc/sm_modbus.hpp"
 
 namespace sm
@@ -27,6 +34,9 @@ namespace sm
 constexpr int boot_version_size = 17;
 constexpr int boot_name_size = 33;
 constexpr int amount_of_regs = 10;
+// registers after the status block, read only from servers holding images
+// of more than modbus::max_num_of_records records
+constexpr int amount_of_ext_regs = 2;
 constexpr int not_connected = 255;
 constexpr std::uint16_t file_read_prepare = 1;
 constexpr std::uint16_t file_write_prepare = 2;
@@ -34,6 +44,19 @@ constexpr std::uint16_t app_erase_request = 1;
 constexpr std::uint16_t app_start_request = 1;
 ////////////////////////////////////////////////////////////////////////////////
 
+//////////////////////////////CLIENT CONSTANTS//////////////////////////////////
+// USB-serial adapters deliver received bytes in bursts, up to their latency timer
+constexpr std::chrono::milliseconds line_latency{16};
+// file write requests kept outstanding at once, for servers accepting several
+constexpr int max_transfer_window = 16;
+// attempts to send one request in windowed transfer before the task fails
+constexpr int max_transfer_attempts = 3;
+// acknowledged records read back from the server before interrupted upload is resumed
+constexpr int journal_verify_records = 4;
+// time given to servers to process broadcast request, they do not respond to it
+constexpr std::chrono::microseconds broadcast_turnaround{5000};
+////////////////////////////////////////////////////////////////////////////////
+
 enum class ServerRegisters
 {
     file_control = 0,
@@ -45,7 +68,11 @@ enum class ServerRegisters
     record_size = 6,
     gateway_buffer_size = 7,
     record_counter = 8,
-    gateway_file_control = 9
+    gateway_file_control = 9,
+    // extended registers, written only for images of more than
+    // modbus::max_num_of_records records, so other servers never see them
+    app_size_high = 10, // upper half of app_size, cleared by app_size write
+    file_bank = 11      // record number is file_bank * max_num_of_records + record id, cleared by file_control write
 };
 
 enum class BootloaderStatus
@@ -59,7 +86,8 @@ enum class BootloaderStatus
 enum class ServerFiles
 {
     application = 1,
-    server_metadata = 2
+    server_metadata = 2,
+    record_checksums = 3 // crc16 of every application record, big-endian half words
 };
 
 enum class ClientTasks
@@ -69,6 +97,8 @@ enum class ClientTasks
     reg_write,
     file_read,
     file_write,
+    file_verify,
+    broadcast,//file records or registers written to address 0, no responce expected
     ping,//extra command, FunctionCodes::undefined used
     app_start//extra command, the same as reg_write, but no responce expected
 };
@@ -82,6 +112,17 @@ struct TaskAttributes
     }
     modbus::FunctionCodes code = modbus::FunctionCodes::undefined;
     size_t length = 0;
+    /// @brief first file record in request, used to match responses in windowed transfer
+    int record = -1;
+    /// @brief amount of file records in request
+    int num_of_records = 0;
+    /// @brief request from frame cache, request_data is sent if not set
+    const std::uint8_t* frame = nullptr;
+    /// @brief server address, function code and file id of sent request,
+    /// response has to carry the same ones
+    std::uint8_t addr = 0;
+    std::uint8_t function = 0;
+    std::uint16_t file_id = 0;
 };
 
 struct TaskInfo
@@ -95,6 +136,8 @@ struct TaskInfo
     int num_of_exchanges = 0;
     int counter = 0;
     int index = -1;
+    /// @brief amount of requests sent without waiting for responses, 1 for stop-and-wait
+    int window = 1;
     std::atomic<bool> done = false;
     void reset(ClientTasks task = ClientTasks::undefined, int num_of_exchanges = 0, int index = -1)
     {
@@ -102,12 +145,19 @@ struct TaskInfo
         this->num_of_exchanges = num_of_exchanges;
         this->index = index;
         counter = 0;
+        window = 1;
         done = false;
         attributes = TaskAttributes();
         error_code = std::error_code();
     }
 };
 
+struct RegisterWrite
+{
+    std::uint16_t reg = 0;
+    std::uint16_t value = 0;
+};
+
 #pragma pack(push)
 #pragma pack(2)
 struct BootloaderInfo
@@ -128,13 +178,17 @@ struct ServerInfo
 {
     std::uint8_t addr = 0;
     std::uint8_t gateway_addr = 0;
+    /// @brief file write requests sent to the server without waiting for responses
+    int transfer_window = 1;
+    /// @brief true after successful eraseApp until the next upload
+    bool erased = false;
     ServerStatus status = ServerStatus::Unavailable;
 };
 
 struct ServerData
 {
     ServerInfo info;
-    std::uint16_t regs[amount_of_regs] = {};
+    std::uint16_t regs[amount_of_regs + amount_of_ext_regs] = {};
     BootloaderInfo data = {};
 };
 
@@ -156,6 +210,44 @@ public:
     /// @param config used config
     /// @return error code
     std::error_code configure(sp::PortConfig config);
+    /// @brief pad RTU frames with zero bytes, enabled by default for servers
+    /// which expect padding, line silence is kept with t3.5 timing anyway
+    /// @param enabled true to pad frames
+    void setRtuPadding(const bool enabled) { modbus_client.setRtuPadding(enabled); }
+    /// @brief select Modbus mode used by servers on the line, RTU by default
+    /// @param mode new mode
+    void setMode(const modbus::ModbusMode mode) { modbus_client.setMode(mode); }
+    /// @brief pack as many file records into one file record request as fit
+    /// into PDU, disabled by default for servers handling one record per request
+    /// @param enabled true to pack records
+    void setRecordPacking(const bool enabled) { record_packing = enabled; }
+    /// @brief keep several file write requests outstanding, for servers and
+    /// gateways on full-duplex lines which buffer requests, responses are
+    /// matched by record id and only failed requests are sent again
+    /// @param address server address
+    /// @param window amount of outstanding requests, 1 (default) for stop-and-wait,
+    /// limited by max_transfer_window
+    void setTransferWindow(const std::uint8_t address, const int window);
+    /// @brief send only records which differ from the application held by the
+    /// server, checksums of its records are read from ServerFiles::record_checksums,
+    /// used if the server reports BootloaderStatus::ready, disabled by default
+    /// @param enabled true to enable delta upload
+    void setDeltaUpload(const bool enabled) { delta_upload = enabled; }
+    /// @brief skip blank (0xFF only) records in upload right after successful
+    /// eraseApp, app_size still covers the whole image, disabled by default
+    /// @param enabled true to enable sparse upload
+    void setSparseUpload(const bool enabled) { sparse_upload = enabled; }
+    /// @brief keep journal of acknowledged records for every upload, upload of
+    /// the same image to the same server resumes from the first record which is
+    /// not acknowledged, records written last are read back before that
+    /// @param directory directory to keep journal files in, empty (default) to disable
+    void setUploadJournal(const std::string& directory) { journal_directory = directory; }
+    /// @brief keep write file requests of uploaded image encoded, following
+    /// uploads of the same image by any client of the process send them as
+    /// they are, requests for another server address are re-stamped only,
+    /// disabled by default
+    /// @param enabled true to cache requests
+    void setFrameCache(const bool enabled) { frame_caching = enabled; }
     /// @brief add server to the internal servers list
     /// @brief connect to server with selected id
     /// @param address server address
@@ -168,6 +260,19 @@ public:
     /// @param path_to_file path to file
     /// @return error code
     std::error_code uploadApp(const std::uint8_t address, const std::string path_to_file);
+    /// @brief upload the same firmware to several servers on one bus at once:
+    /// records are sent once to broadcast address 0, then every server is
+    /// checked by ServerFiles::record_checksums and gets missing records by
+    /// unicast, servers without checksums get full unicast upload
+    /// @param addresses servers connected directly, with the same record size,
+    /// RTU padding must be disabled as zero address can't be told from padding
+    /// @param path_to_file path to file
+    /// @return error code of the first server which failed, the rest are flashed anyway
+    std::error_code uploadAppBroadcast(const std::vector<std::uint8_t>& addresses, const std::string path_to_file);
+    /// @brief set pause after every broadcast request, servers must write the
+    /// records in this time
+    /// @param delay pause, broadcast_turnaround by default
+    void setBroadcastDelay(const std::chrono::microseconds delay) { broadcast_delay = delay; }
     /// @brief start application
     /// @return error code
     std::error_code startApp(const std::uint8_t address);
@@ -180,12 +285,15 @@ public:
     /// @brief get actual running task progress in %
     /// @return value from 0 to 100
     int getActualTaskProgress() const;
+    /// @return record bytes acknowledged by the server in the last uploadApp,
+    /// skipped records are not counted
+    size_t getUploadedBytes() const { return uploaded_bytes; }
 
 private:
     /// @brief buffer for request message data
-    std::vector<std::uint8_t> request_data;
-    /// @brief buffer for response message data
-    std::vector<std::uint8_t> responce_data;
+    modbus::Frame request_data;
+    /// @brief parser for response message data
+    modbus::FrameParser responce_parser;
     /// @brief modbus protocol message generator
     modbus::ModbusClient modbus_client;
     /// @brief file control instance
@@ -194,18 +302,53 @@ private:
     sp::SerialPort serial_port;
     /// @brief vector with actual available modbus devices
     std::vector<ServerData> servers;
-    /// @brief client-server data thread
-    std::thread client_thread;
     /// @brief logic semaphore to stop client_thread
     std::atomic<bool> thread_stop{false};
-    /// @brief async client task variable
-    std::future<void> task;
+    /// @brief last gateway_buffer_size value written to every gateway, by
+    /// gateway address, used to skip unchanged writes, accessed by caller only
+    std::map<std::uint8_t, std::uint16_t> gateway_buffer_sizes;
+    /// @brief true if several file records are sent in one request
+    bool record_packing = false;
+    /// @brief true if only changed records are uploaded
+    bool delta_upload = false;
+    /// @brief true if blank records are not sent to erased server
+    bool sparse_upload = false;
+    /// @brief records the server already holds with the same content, filled
+    /// for delta and sparse upload only
+    std::vector<bool> unchanged_records;
+    /// @brief true if write file requests are taken from frame cache
+    bool frame_caching = false;
+    /// @brief requests of actual file write task, nullptr if caching is disabled
+    std::shared_ptr<const FrameCache> frame_cache;
+    /// @brief directory with upload journals, empty if resumable upload is disabled
+    std::string journal_directory;
+    /// @brief journal of actual upload, opened by uploadApp only
+    Journal journal;
+    /// @brief record bytes acknowledged in actual upload
+    size_t uploaded_bytes = 0;
+    /// @brief pause after broadcast request
+    std::chrono::microseconds broadcast_delay = broadcast_turnaround;
+    /// @brief RTU timing calculated from port configuration
+    modbus::FrameTiming frame_timing;
+    /// @brief time point when the line has been silent for t3.5 after last frame
+    std::chrono::steady_clock::time_point bus_idle_time;
     /// @brief info about actual pending task and function
     TaskInfo task_info = TaskInfo(ClientTasks::undefined, 0,-1);
+    /// @brief mutex for task_done_cv
+    std::mutex task_done_mutex;
+    /// @brief used to wake caller up when pending task is finished
+    std::condition_variable task_done_cv;
     /// @brief queue with client-server exchanges
     std::queue<std::function<void()>> q_exchange;
-    /// @brief queue with client tasks
+    /// @brief queue with client tasks, filled by API calls, used by client_thread
     std::queue<std::function<void()>> q_task;
+    /// @brief mutex for q_task and task_queue_cv
+    std::mutex task_queue_mutex;
+    /// @brief used to wake client_thread up on new task or stop request
+    std::condition_variable task_queue_cv;
+    /// @brief client-server data thread, declared last to start after all
+    /// members it uses are constructed
+    std::thread client_thread;
     /// @brief ping server selected by address
     /// @param dev_addr server address
     /// @return error code
@@ -214,8 +357,19 @@ private:
     /// @param dev_addr server address
     /// @param reg_addr register address
     /// @param value new value
+    /// @param gateway_setup false for the gateway buffer write made on the way
+    /// to a server behind the gateway, it is not set up again
+    /// @return error code
+    std::error_code taskWriteRegister(const std::uint8_t dev_addr, const std::uint16_t reg_addr, const std::uint16_t value,
+                                      const bool gateway_setup = true);
+    /// @brief write several registers on the server selected by address, writes
+    /// to adjacent registers are merged into one write multiple registers request
+    /// @param dev_addr server address
+    /// @param writes pointer to register writes, in any order, the last write wins
+    /// if register is repeated
+    /// @param count amount of register writes
     /// @return error code
-    std::error_code taskWriteRegister(const std::uint8_t dev_addr, const std::uint16_t reg_addr, const std::uint16_t value);
+    std::error_code taskWriteRegisters(const std::uint8_t dev_addr, const RegisterWrite* writes, const size_t count);
     /// @brief read registers from the server selected by address
     /// @param dev_addr server address
     /// @param reg_addr register start address
@@ -231,27 +385,121 @@ private:
     /// @param dev_addr server address
     /// @return error code
     std::error_code taskWriteFile(const std::uint8_t dev_addr);
+    /// @brief write file stored in file control instance to broadcast address,
+    /// file bank is selected by broadcast as well
+    /// @param record_size record size in bytes
+    /// @return error code, only port errors are detected
+    std::error_code taskBroadcastFile(const std::uint16_t record_size);
+    /// @brief write size of the file stored in file control instance and
+    /// prepare the server for file writing
+    /// @param dev_addr server address
+    /// @return error code
+    std::error_code taskPrepareUpload(const std::uint8_t dev_addr);
+    /// @brief select bank of the record on the server, done only if file
+    /// control instance holds more than modbus::max_num_of_records records
+    /// @param dev_addr server address
+    /// @param record record number in file
+    /// @return error code
+    std::error_code taskSetFileBank(const std::uint8_t dev_addr, const int record);
+    /// @param record record number in file
+    /// @return bank holding the record
+    static int getFileBank(const int record) { return record / modbus::max_num_of_records; }
+    /// @param record record number in file
+    /// @return record id in its bank, as it is sent to the server
+    static std::uint16_t getRecordId(const int record) { return static_cast<std::uint16_t>(record % modbus::max_num_of_records); }
+    /// @brief check if write is not needed because gateway already holds the value
+    /// @param dev_addr server address
+    /// @param reg_addr register address
+    /// @param value value to write
+    /// @return true if register is gateway_buffer_size and value is the same as
+    /// the last one written successfully
+    bool isGatewayBufferSizeSet(const std::uint8_t dev_addr, const std::uint16_t reg_addr, const std::uint16_t value) const;
+    /// @brief read records back from the server and compare them with the
+    /// file stored in file control instance
+    /// @param dev_addr server address
+    /// @param records record ids to read
+    /// @return error code, ClientErrors::image_mismatch if any record differs
+    std::error_code taskVerifyRecords(const std::uint8_t dev_addr, const std::vector<int>& records);
+    /// @brief open journal for upload of the file stored in file control
+    /// instance, acknowledged records are kept only if the server still holds them
+    /// @param dev_addr server address
+    /// @param record_size record size in bytes
+    void openUploadJournal(const std::uint8_t dev_addr, const std::uint16_t record_size);
+    /// @brief get requests of the file stored in file control instance from
+    /// frame cache or encode them, requests never cross bank boundary or gap
+    /// @param dev_addr server address
+    /// @param record_size record size in bytes
+    /// @param records_per_exchange maximum amount of records in request
+    void prepareFrameCache(const std::uint8_t dev_addr, const std::uint16_t record_size, const int records_per_exchange);
+    /// @brief get amount of file records sent in one request
+    /// @param code FunctionCodes::read_file or FunctionCodes::write_file
+    /// @param record_size record length in bytes
+    /// @return amount of records, 1 if packing is disabled
+    int getRecordsPerExchange(const modbus::FunctionCodes code, const size_t record_size) const;
+    /// @brief find records which the server holds with the same content as
+    /// the file stored in file control instance, fills unchanged_records
+    /// @param dev_addr server address
+    /// @return error code
+    std::error_code findUnchangedRecords(const std::uint8_t dev_addr);
+    /// @brief check if record does not need to be sent in actual upload
+    /// @param record record id
+    /// @return true if record is a gap in the image, acknowledged in journal or unchanged
+    bool isRecordSkipped(const int record) const;
     /// @brief get expected file size based on server predefined logic
     /// @param file_id file id in Modbus application layer
+    /// @param server server data with registers read on connection
     /// @return file size in bytes
-    static size_t getFileSize(const ServerFiles file_id);
+    static size_t getFileSize(const ServerFiles file_id, const ServerData& server);
+    /// @param server server data with registers read on connection
+    /// @return application size in records, app_size_high included
+    static size_t getAppSize(const ServerData& server);
     /// @brief get server index in servers vector
     /// @param address server address
     /// @return actual index or -1 if server not exist
     int getServerIndex(const std::uint8_t address);
+    /// @brief block caller until actual task is finished by client_thread
+    /// @return task error code
+    std::error_code waitTaskDone();
+    /// @brief mark actual task as finished and wake caller up
+    void setTaskDone();
+    /// @brief pass new task to client_thread and wake it up
+    /// @param task task function, fills q_exchange on client_thread
+    void pushTask(std::function<void()> task);
     /// @brief handler for client_thread
     void clientThread();
-    /// @brief async call for callServerExchange method
+    /// @brief run exchange with new attributes on calling client_thread
     /// @param attr new task attributes
     void createServerRequest(const TaskAttributes& attr);
     /// @brief call request/response exchange on data prepared in request_data
     void callServerExchange();
+    /// @brief send request prepared in request_data
+    void sendRequest();
+    /// @brief receive response into responce_parser
+    void receiveResponse();
+    /// @brief check if received response comes from the server and for the
+    /// file records of the request
+    /// @param attr attributes of the request
+    /// @return true if response belongs to the request
+    bool isResponseMatching(const TaskAttributes& attr) const;
+    /// @brief run exchanges from q_exchange keeping task_info.window requests
+    /// outstanding, requests without valid response are sent again
+    void runWindowedExchanges();
+    /// @brief switch read timeout between port timeout and character gap
+    /// timeout (t1.5), used to detect broken frame after first received byte
+    /// @param enabled true for character gap timeout
+    void setFrameGapTimeout(const bool enabled);
     /// @brief callback called for every function in q_exchange
     void exchangeCallback();
     /// @brief callback called for every ClientTasks::file_read
     /// @param message reference to a vector with the message read
     /// @param index server index in servers vector
     void fileReadCallback(std::vector<std::uint8_t>& message,const int index);
+    /// @brief called for every acknowledged write file request
+    /// @param attr attributes of acknowledged request
+    void fileWriteCallback(const TaskAttributes& attr);
+    /// @brief callback called for every ClientTasks::file_verify
+    /// @param attr attributes of the request
+    void fileVerifyCallback(const TaskAttributes& attr);
 };
 } // namespace sm
 
@@ -0,0 +1,77 @@
+/**
+ * @file sm_crc.hpp
+ *
+ * @brief CRC-16/IBM (Modbus) engines with runtime selection
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#ifndef SM_CRC_H
+#define SM_CRC_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace modbus
+{
+//////////////////////////////////CRC CONSTANTS/////////////////////////////////
+constexpr std::uint16_t crc16_poly = 0xA001U; // reflected 0x8005
+constexpr std::uint16_t crc16_init = 0xFFFFU;
+////////////////////////////////////////////////////////////////////////////////
+
+enum class CrcEngine
+{
+    bitwise,      // reference implementation, 8 shifts per byte
+    table,        // one 256 entries table lookup per byte
+    slicing_by_8, // 8 tables, 8 bytes per iteration
+    clmul         // carry-less multiplication folding (x86 PCLMULQDQ)
+};
+
+/// @brief calculate crc16 with engine selected at runtime
+/// @param data pointer to data
+/// @param length data length in bytes
+/// @param crc initial value, pass previous result to continue calculation
+/// @return calculated crc
+std::uint16_t crc16(const std::uint8_t* data, const size_t length, const std::uint16_t crc = crc16_init);
+/// @brief calculate crc16 with selected engine
+/// @param engine engine to use, must be supported on actual CPU
+/// @param data pointer to data
+/// @param length data length in bytes
+/// @param crc initial value, pass previous result to continue calculation
+/// @return calculated crc
+std::uint16_t crc16(const CrcEngine engine, const std::uint8_t* data, const size_t length, const std::uint16_t crc = crc16_init);
+/// @brief check if engine can be used on actual CPU
+/// @param engine engine to check
+/// @return true if supported
+bool isCrcEngineSupported(const CrcEngine engine);
+/// @brief select engine used by crc16 calls without explicit engine
+/// @param engine new engine
+/// @return true in case of success, false if engine is not supported
+bool setCrcEngine(const CrcEngine engine);
+/// @brief get engine used by crc16 calls without explicit engine
+/// @return actual engine, the fastest supported one by default
+CrcEngine getCrcEngine();
+/// @brief continue crc16 over zero bytes without reading them, O(log n)
+/// @param crc crc of preceding data
+/// @param zero_bytes amount of zero bytes
+/// @return crc of preceding data followed by zero bytes
+std::uint16_t crc16Shift(std::uint16_t crc, size_t zero_bytes);
+/// @brief get crc16 of two blocks written one after another from their crcs
+/// @param crc_a crc of the first block
+/// @param crc_b crc of the second block, calculated from crc16_init
+/// @param length_b second block length in bytes
+/// @return crc of both blocks
+std::uint16_t crc16Combine(const std::uint16_t crc_a, const std::uint16_t crc_b, const size_t length_b);
+/// @brief update crc16 of data after one byte is changed, data is not read
+/// @param crc crc of data before the change
+/// @param length data length in bytes
+/// @param position index of changed byte
+/// @param old_value byte value before the change
+/// @param new_value byte value after the change
+/// @return crc of changed data
+std::uint16_t crc16Patch(const std::uint16_t crc, const size_t length, const size_t position, const std::uint8_t old_value,
+                         const std::uint8_t new_value);
+} // namespace modbus
+
+#endif // SM_CRC_H
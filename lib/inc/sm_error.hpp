@@ -23,6 +23,9 @@ enum class ClientErrors
     server_not_exist,
     server_not_connected,
     gateway_not_responding,
+    image_mismatch,
+    broadcast_not_supported,
+    unexpected_response,
     internal
 };
 
@@ -11,12 +11,28 @@
 #define SM_FILE_H
 
 #include "../inc/sm_error.hpp"
+#include "../inc/sm_image.hpp"
 #include "../inc/sm_modbus.hpp"
 #include <fstream>
 #include <memory>
+#include <vector>
 
 namespace sm
 {
+//////////////////////////////IMAGE FILE CONSTANTS//////////////////////////////
+constexpr std::uint8_t intel_hex_data = 0x00;
+constexpr std::uint8_t intel_hex_end_of_file = 0x01;
+constexpr std::uint8_t intel_hex_extended_segment_address = 0x02;
+constexpr std::uint8_t intel_hex_start_segment_address = 0x03;
+constexpr std::uint8_t intel_hex_extended_linear_address = 0x04;
+constexpr std::uint8_t intel_hex_start_linear_address = 0x05;
+constexpr size_t intel_hex_address_length = 2;       // extended address records
+constexpr size_t intel_hex_start_address_length = 4; // start address records
+// records of one image, record ids above modbus::max_num_of_records are
+// reached through 16-bit file bank register
+constexpr int max_image_records = modbus::max_num_of_records * 0x10000;
+////////////////////////////////////////////////////////////////////////////////
+
 class File
 {
 public:
@@ -27,7 +43,12 @@ public:
     /// @param file_size file size to read
     /// @return true in case of success
     bool fileReadSetup(const std::uint16_t id, const size_t file_size, const std::uint8_t record_size);
-    /// @brief prepare instance for file sending to the server
+    /// @brief prepare instance for file sending to the server, Intel HEX
+    /// (.hex, .ihex) and S-record (.srec, .s19, .s28, .s37, .mot) files are
+    /// mapped onto records starting from the lowest address aligned to record
+    /// size, records not touched by any data are gaps and are not stored,
+    /// any other file is taken as flat binary and is memory-mapped, records
+    /// are sent straight from the mapping shared with other clients
     /// @param id file id on the server
     /// @param path_to_file path to file on the disk
     /// @return true in case of success
@@ -39,17 +60,37 @@ public:
     std::uint16_t getActualRecordLength(const int index) const;
     /// @brief get actual number of records
     /// @return number of records
-    std::uint16_t getNumOfRecords() const { return num_of_records; };
-    /// @brief load record from Modbus PDU
-    /// @param message vector with PDU
+    int getNumOfRecords() const { return num_of_records; };
+    /// @brief load records from read file record response, records are
+    /// expected in file order, several sub-responses per message are supported
+    /// @param message vector with response: address, PDU, crc
     /// @return true in case of success
     bool getRecordFromMessage(const std::vector<std::uint8_t>& message);
+    /// @brief find records filled with 0xFF only, the same as erased flash
+    /// @return one flag per record, true if record is blank
+    std::vector<bool> getBlankRecords() const;
+    /// @brief get hash of populated records together with their indexes, it
+    /// is calculated once per loaded image, mapped binary shares it with other
+    /// clients uploading the same file
+    /// @return hash of the image
+    std::uint64_t getImageHash() const;
     /// @brief check if file is loaded completely
     /// @return true if yes false if not
     bool isFileReady() const { return ready; }
-    /// @brief get pointer to file
+    /// @brief get pointer to file read from the server
     /// @return pointer to buffer with file
     std::uint8_t* getData() const { return data.get(); }
+    /// @brief get pointer to record data
+    /// @param index record index in file
+    /// @return pointer to record_size bytes, nullptr if record is a gap
+    const std::uint8_t* getRecordData(const int index) const;
+    /// @brief check if record holds any data of the file
+    /// @param index record index in file
+    /// @return false if record is a gap between sections
+    bool isRecordPopulated(const int index) const { return getRecordData(index) != nullptr; }
+    /// @brief get address of record 0 in HEX or S-record file
+    /// @return address, 0 for binary file
+    std::uint32_t getBaseAddress() const { return base_address; }
     /// @brief get file id
     /// @return actual file id
     std::uint16_t getId() const { return id; }
@@ -59,17 +100,64 @@ public:
     size_t getFileSize(const std::string path_to_file) const;
 
 private:
+    /// @brief run of populated records stored in data buffer or image mapping
+    struct Segment
+    {
+        int first_record;
+        int num_of_records;
+        /// @brief pointer to the first record
+        const std::uint8_t* records;
+    };
+    /// @brief data read from HEX or S-record file, adjacent lines are merged
+    struct Chunk
+    {
+        std::uint32_t address;
+        std::vector<std::uint8_t> data;
+    };
     std::unique_ptr<std::uint8_t[]> data;
+    /// @brief mapping of binary file, data keeps only its partial last record then
+    std::shared_ptr<const MappedImage> image;
+    /// @brief populated records sorted by record index
+    std::vector<Segment> segments;
+    std::uint32_t base_address = 0;
     size_t file_size = 0;
-    std::uint16_t num_of_records = 0;
-    std::uint16_t counter = 0;
+    int num_of_records = 0;
+    int counter = 0;
     std::uint16_t id = 0;
     std::uint8_t record_size = 0;
     bool ready = false;
+    /// @brief image hash, valid if image_hash_ready is set
+    mutable std::uint64_t image_hash = 0;
+    mutable bool image_hash_ready = false;
+    /// @brief hash records of the image
+    /// @return hash of the image
+    std::uint64_t calcImageHash() const;
     /// @brief get num of records in file
     /// @param file_size file size in bytes
     /// @return expected number of records
-    std::uint16_t calcNumOfRecords(const size_t file_size) const;
+    int calcNumOfRecords(const size_t file_size) const;
+    /// @brief map flat binary file, it is read to RAM buffer if mapping fails
+    /// @param path_to_file path to file on the disk
+    /// @return true in case of success
+    bool loadBinary(const std::string& path_to_file);
+    /// @brief read Intel HEX file line by line
+    /// @param path_to_file path to file on the disk
+    /// @param chunks vector to save data to
+    /// @return true if file is valid
+    static bool readIntelHex(const std::string& path_to_file, std::vector<Chunk>& chunks);
+    /// @brief read Motorola S-record file line by line
+    /// @param path_to_file path to file on the disk
+    /// @param chunks vector to save data to
+    /// @return true if file is valid
+    static bool readSrecord(const std::string& path_to_file, std::vector<Chunk>& chunks);
+    /// @brief append data to the last chunk if it continues it, add new chunk
+    /// otherwise, empty data adds nothing
+    static void addChunk(std::vector<Chunk>& chunks, const std::uint32_t address, const std::uint8_t* bytes, const size_t length);
+    /// @brief sort chunks and map them onto records, only populated records
+    /// are stored, free space of them is filled with 0xFF as erased flash
+    /// @param chunks data read from file
+    /// @return true in case of success
+    bool mapChunks(std::vector<Chunk>& chunks);
 };
 } // namespace sm
 
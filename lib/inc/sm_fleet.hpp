@@ -0,0 +1,78 @@
+/**
+ * @file sm_fleet.hpp
+ *
+ * @brief firmware upload to many servers on separate serial ports at once
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#ifndef SM_FLEET_H
+#define SM_FLEET_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "../inc/sm_client.hpp"
+
+namespace sm
+{
+/// @brief one board of the manifest
+struct FleetJob
+{
+    std::string port;
+    std::uint8_t address = 0;
+    /// @brief gateway server address, 0 if the server is connected directly
+    std::uint8_t gateway = 0;
+    std::string image;
+};
+
+struct FleetResult
+{
+    FleetJob job;
+    std::error_code error;
+    /// @brief record bytes acknowledged by the server
+    size_t uploaded_bytes = 0;
+    /// @brief connection and upload time
+    std::chrono::duration<double> elapsed{0};
+};
+
+/// @brief runs one session per port, every session owns a Client with its own
+/// client_thread, so a running port takes a session thread and a client
+/// thread, ports do not share a pool of I/O threads
+class Fleet
+{
+public:
+    /// @param config port configuration used for all ports
+    explicit Fleet(const sp::PortConfig& config) : config(config) {}
+    /// @brief read manifest, one board per line: port, server address,
+    /// gateway address (0 if none) and image path separated by spaces, empty
+    /// lines and lines starting with '#' are skipped
+    /// @param path_to_file path to manifest
+    /// @param jobs vector to save boards to
+    /// @return true in case of success, false if file can't be read or a line is invalid
+    static bool loadManifest(const std::string& path_to_file, std::vector<FleetJob>& jobs);
+    /// @brief upload images to all boards, boards on one port share the bus
+    /// and are flashed one after another by one session, sessions of
+    /// different ports run in parallel on session threads
+    /// @param jobs boards to flash
+    /// @param workers amount of sessions run at once, 0 for one per port,
+    /// every running session takes two threads, so up to 2 * workers
+    /// threads run
+    /// @return one result per job, in the same order
+    std::vector<FleetResult> run(const std::vector<FleetJob>& jobs, const size_t workers = 0) const;
+
+private:
+    sp::PortConfig config;
+    /// @brief flash boards of one port with one client
+    /// @param jobs all boards
+    /// @param session indexes of boards on the port
+    /// @param results vector to save results to, only session entries are written
+    void runSession(const std::vector<FleetJob>& jobs, const std::vector<size_t>& session, std::vector<FleetResult>& results) const;
+};
+} // namespace sm
+
+#endif // SM_FLEET_H
@@ -0,0 +1,97 @@
+/**
+ * @file sm_frame_cache.hpp
+ *
+ * @brief write file record requests of an image encoded once and kept in one
+ * arena, shared by all clients uploading the same image
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#ifndef SM_FRAME_CACHE_H
+#define SM_FRAME_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "../inc/sm_modbus.hpp"
+
+namespace sm
+{
+/////////////////////////////FRAME CACHE CONSTANTS//////////////////////////////
+// encoded images kept by the process, the least recently used one is dropped first
+constexpr size_t frame_cache_capacity = 4;
+////////////////////////////////////////////////////////////////////////////////
+
+/// @brief everything the encoded frames depend on
+struct FrameCacheKey
+{
+    std::uint64_t image_hash = 0;
+    std::uint16_t file_id = 0;
+    std::uint16_t record_size = 0;
+    int records_per_exchange = 0;
+    modbus::ModbusMode mode = modbus::ModbusMode::rtu;
+    bool rtu_padding = true;
+    std::uint8_t addr = 0;
+    /// @return true if frames differ in server address only
+    bool isSameLayout(const FrameCacheKey& other) const
+    {
+        return (image_hash == other.image_hash) && (file_id == other.file_id) && (record_size == other.record_size) &&
+               (records_per_exchange == other.records_per_exchange) && (mode == other.mode) && (rtu_padding == other.rtu_padding);
+    }
+    bool operator==(const FrameCacheKey& other) const { return isSameLayout(other) && (addr == other.addr); }
+};
+
+/// @brief encoded request from the arena
+struct CachedFrame
+{
+    const std::uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+class FrameCache
+{
+public:
+    /// @param key frames description
+    /// @param num_of_records amount of records in the image
+    FrameCache(const FrameCacheKey& key, const int num_of_records);
+    /// @brief append encoded request to the arena
+    /// @param first_record first record in request
+    /// @param num_of_records amount of records in request
+    /// @param frame encoded request
+    void add(const int first_record, const int num_of_records, const modbus::Frame& frame);
+    /// @brief find request for exactly these records
+    /// @param first_record first record in request
+    /// @param num_of_records amount of records in request
+    /// @return encoded request, empty if requests are split in another way
+    CachedFrame find(const int first_record, const int num_of_records) const;
+    const FrameCacheKey& getKey() const { return key; }
+    /// @brief get frames of the process cache, frames encoded for another
+    /// server address are copied and re-stamped with the address of the key
+    /// @param key frames description
+    /// @param encoder encoder in the mode of the key
+    /// @return shared frames, nullptr if the image is not cached yet
+    static std::shared_ptr<const FrameCache> lookup(const FrameCacheKey& key, const modbus::ModbusClient& encoder);
+    /// @brief keep frames in the process cache
+    /// @param cache frames to share
+    static void store(const std::shared_ptr<const FrameCache>& cache);
+
+private:
+    struct Entry
+    {
+        size_t offset = 0;
+        std::uint16_t size = 0;
+        std::uint16_t num_of_records = 0;
+    };
+    FrameCacheKey key;
+    /// @brief requests stored back to back
+    std::vector<std::uint8_t> arena;
+    std::vector<Entry> entries;
+    /// @brief entry of request starting with the record, -1 if there is none
+    std::vector<int> first_record_entries;
+};
+} // namespace sm
+
+#endif // SM_FRAME_CACHE_H
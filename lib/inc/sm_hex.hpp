@@ -0,0 +1,62 @@
+/**
+ * @file sm_hex.hpp
+ *
+ * @brief hex encoding of Modbus ASCII frames, engines with runtime selection
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#ifndef SM_HEX_H
+#define SM_HEX_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace modbus
+{
+enum class HexEngine
+{
+    scalar, // one table lookup per byte
+    sse2,   // 16 bytes per iteration
+    avx2    // 32 bytes per iteration
+};
+
+/// @brief encode bytes as upper case hex characters, high nibble first
+/// @param data pointer to data
+/// @param length data length in bytes
+/// @param hex pointer to save 2 * length characters to
+void hexEncode(const std::uint8_t* data, const size_t length, std::uint8_t* hex);
+/// @brief encode bytes with selected engine
+/// @param engine engine to use, must be supported on actual CPU
+/// @param data pointer to data
+/// @param length data length in bytes
+/// @param hex pointer to save 2 * length characters to
+void hexEncode(const HexEngine engine, const std::uint8_t* data, const size_t length, std::uint8_t* hex);
+/// @brief decode hex characters, lower case is accepted as well
+/// @param hex pointer to 2 * length characters
+/// @param length amount of bytes to decode
+/// @param data pointer to save decoded bytes to
+/// @return false if any character is not a hex digit
+bool hexDecode(const std::uint8_t* hex, const size_t length, std::uint8_t* data);
+/// @brief decode hex characters with selected engine
+/// @param engine engine to use, must be supported on actual CPU
+/// @param hex pointer to 2 * length characters
+/// @param length amount of bytes to decode
+/// @param data pointer to save decoded bytes to
+/// @return false if any character is not a hex digit
+bool hexDecode(const HexEngine engine, const std::uint8_t* hex, const size_t length, std::uint8_t* data);
+/// @brief check if engine can be used on actual CPU
+/// @param engine engine to check
+/// @return true if supported
+bool isHexEngineSupported(const HexEngine engine);
+/// @brief select engine used by calls without explicit engine
+/// @param engine new engine
+/// @return true in case of success, false if engine is not supported
+bool setHexEngine(const HexEngine engine);
+/// @brief get engine used by calls without explicit engine
+/// @return actual engine, the fastest supported one by default
+HexEngine getHexEngine();
+} // namespace modbus
+
+#endif // SM_HEX_H
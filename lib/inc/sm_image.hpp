@@ -0,0 +1,76 @@
+/**
+ * @file sm_image.hpp
+ *
+ * @brief read-only memory-mapped firmware image, one mapping is shared by
+ * all users of the same file
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#ifndef SM_IMAGE_H
+#define SM_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace sm
+{
+class MappedImage
+{
+public:
+    MappedImage(const MappedImage&) = delete;
+    MappedImage& operator=(const MappedImage&) = delete;
+    ~MappedImage() { unmap(); }
+    /// @brief map file to memory or get mapping already opened for it, the
+    /// mapping is reused while the file is not changed on the disk
+    /// @param path_to_file path to file on the disk
+    /// @return shared mapping, nullptr if file is empty or can't be mapped
+    static std::shared_ptr<const MappedImage> open(const std::string& path_to_file);
+    /// @return pointer to the first byte of the file
+    const std::uint8_t* getData() const { return view; }
+    /// @return file size in bytes
+    size_t getSize() const { return size; }
+    /// @brief get hash of the image split to records, it is kept by file path
+    /// while the file is not changed on the disk, the first user of the file
+    /// calculates it, the others and the next mappings get the same value
+    /// @param record_size record size the hash depends on
+    /// @param calculate function calculating the hash
+    /// @return hash of the image
+    std::uint64_t getHash(const std::uint8_t record_size, const std::function<std::uint64_t()>& calculate) const;
+
+private:
+    /// @brief file properties to detect the file is replaced or modified
+    struct Stamp
+    {
+        std::uint64_t size = 0;
+        std::uint64_t modified = 0;
+        std::uint64_t inode = 0;
+        bool operator==(const Stamp& other) const { return (size == other.size) && (modified == other.modified) && (inode == other.inode); }
+    };
+    const std::uint8_t* view = nullptr;
+    size_t size = 0;
+    Stamp stamp;
+    std::string path;
+    /// @brief platform file and mapping handles, only file_desc is used on Linux
+    int file_desc = -1;
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+    MappedImage() = default;
+    /// @brief open file and map it to memory for sequential reading
+    /// @param path_to_file path to file on the disk
+    /// @return true in case of success
+    bool map(const std::string& path_to_file);
+    void unmap();
+    /// @brief get file properties
+    /// @param path_to_file path to file on the disk
+    /// @param stamp struct to save properties to
+    /// @return true if file exists
+    static bool getStamp(const std::string& path_to_file, Stamp& stamp);
+};
+} // namespace sm
+
+#endif // SM_IMAGE_H
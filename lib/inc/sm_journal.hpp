@@ -0,0 +1,109 @@
+/**
+ * @file sm_journal.hpp
+ *
+ * @brief memory-mapped journal of acknowledged file records, used to resume
+ * interrupted upload
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#ifndef SM_JOURNAL_H
+#define SM_JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace sm
+{
+//////////////////////////////JOURNAL CONSTANTS/////////////////////////////////
+constexpr std::uint32_t journal_magic = 0x4A4D5300U; // "\0SMJ"
+constexpr std::uint16_t journal_version = 2;
+constexpr std::uint64_t journal_hash_init = 0xCBF29CE484222325ULL; // FNV-1a 64 offset basis
+////////////////////////////////////////////////////////////////////////////////
+
+class Journal
+{
+public:
+    Journal() = default;
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+    ~Journal() { close(); }
+    /// @brief open journal of the server, journal left by upload of another
+    /// image or with other record size is reset
+    /// @param directory directory to keep journal files in
+    /// @param port serial port the server is connected to
+    /// @param address server address, one journal per server of the port
+    /// @param image_hash hash of the image to upload
+    /// @param num_of_records amount of records in the image
+    /// @param record_size record size in bytes
+    /// @return true in case of success
+    bool open(const std::string& directory, const std::string& port, const std::uint8_t address, const std::uint64_t image_hash,
+              const std::uint32_t num_of_records, const std::uint16_t record_size);
+    /// @brief unmap journal, acknowledged records stay in journal file
+    void close();
+    /// @brief close journal and delete its file
+    void remove();
+    /// @brief forget all acknowledged records
+    void reset();
+    /// @return true if journal is opened
+    bool isOpen() const { return header != nullptr; }
+    /// @brief mark records as written to the server
+    /// @param first_record first record id
+    /// @param count amount of records
+    void setAcknowledged(const int first_record, const int count);
+    /// @param record record id
+    /// @return true if record is written to the server, false if not or journal is closed
+    bool isAcknowledged(const int record) const;
+    /// @return amount of acknowledged records
+    int getNumOfAcknowledged() const;
+    /// @return last acknowledged record id, -1 if there is no one
+    int getLastAcknowledged() const;
+    /// @brief calculate image hash, FNV-1a 64
+    /// @param data pointer to image
+    /// @param length image length in bytes
+    /// @param hash initial value, pass previous result to continue calculation
+    /// @return hash value
+    static std::uint64_t hashImage(const std::uint8_t* data, const size_t length, const std::uint64_t hash = journal_hash_init);
+    /// @brief delete journal file of the server if it exists
+    /// @param directory directory with journal files
+    /// @param port serial port the server is connected to
+    /// @param address server address
+    static void discard(const std::string& directory, const std::string& port, const std::uint8_t address);
+
+private:
+#pragma pack(push)
+#pragma pack(4)
+    struct Header
+    {
+        std::uint32_t magic;
+        std::uint16_t version;
+        std::uint16_t record_size;
+        std::uint32_t num_of_records;
+        std::uint16_t address;
+        std::uint16_t reserved;
+        std::uint64_t image_hash;
+    };
+#pragma pack(pop)
+    Header* header = nullptr;
+    /// @brief one bit per record, set when record is acknowledged
+    std::uint8_t* bitmap = nullptr;
+    size_t mapped_size = 0;
+    std::string path;
+    /// @brief platform file and mapping handles, only file_desc is used on Linux
+    int file_desc = -1;
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+    /// @brief create or open journal file and map it to memory
+    /// @param size file size in bytes
+    /// @return true in case of success
+    bool map(const size_t size);
+    /// @brief journal file path for the server, servers with the same address
+    /// on different ports get different files, port name characters other
+    /// than letters and digits are replaced with '_'
+    static std::string getPath(const std::string& directory, const std::string& port, const std::uint8_t address);
+};
+} // namespace sm
+
+#endif // SM_JOURNAL_H
@@ -10,6 +10,10 @@
 #ifndef SM_MODBUS_H
 #define SM_MODBUS_H
 
+#include "../inc/sm_crc.hpp"
+#include <array>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -17,6 +21,7 @@ namespace modbus
 {
 ////////////////////////////////MODBUS CONSTANTS////////////////////////////////
 constexpr int crc_size = 2;
+constexpr int lrc_size = 1;
 constexpr int address_size = 1;
 constexpr int function_size = 1;
 constexpr int rtu_start_size = 4;
@@ -26,8 +31,17 @@ constexpr int ascii_stop_size = 2;
 constexpr int rtu_msg_edge = (rtu_start_size + rtu_stop_size);
 constexpr int ascii_msg_edge = (ascii_start_size + ascii_stop_size);
 constexpr int rtu_adu_size = (rtu_msg_edge + crc_size + address_size);
-constexpr int ascii_adu_size = (ascii_msg_edge + crc_size + address_size);
+constexpr int ascii_adu_size = (ascii_msg_edge + 2 * (lrc_size + address_size)); // hex characters
+constexpr int max_pdu_size = 253;
+constexpr int max_frame_size = (ascii_adu_size + 2 * max_pdu_size); // ASCII frame is the longest one
+constexpr int min_frame_size = (address_size + function_size + 1 + crc_size);
 constexpr int max_num_of_records = 10000;
+constexpr std::uint8_t broadcast_address = 0; // write requests only, servers do not respond
+constexpr std::uint8_t exception_flag = 0x80; // set in function code of exception response
+constexpr std::uint8_t file_reference_type = 0x06;
+constexpr int file_sub_request_size = 7; // reference type, file id, record id, length
+constexpr int max_file_records = 35;      // read request with 7 bytes sub-requests fits into PDU
+constexpr int max_write_registers = 123;  // write multiple registers limit
 constexpr std::uint16_t holding_regs_offset = 0x9C40;
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -35,6 +49,7 @@ enum class FunctionCodes
 {
     read_registers = 0x03, // read holding registers
     write_register = 0x06, // write single register
+    write_registers = 0x10, // write multiple registers
     read_file = 0x14,      // read file records
     write_file = 0x15,     // write file records
     undefined = 0xFF,      // illegal function code
@@ -42,8 +57,164 @@ enum class FunctionCodes
 
 enum class ModbusMode
 {
-    rtu,
-    ascii
+    rtu,  // binary frame with crc
+    ascii // frame in hex characters with LRC
+};
+
+/// @brief get checksum length of decoded frame
+/// @param mode used Modbus mode
+/// @return crc size for RTU, LRC size for ASCII
+constexpr int getChecksumSize(const ModbusMode mode) { return (mode == ModbusMode::ascii) ? lrc_size : crc_size; }
+
+/// @brief calculate longitudinal redundancy check of ASCII frame
+/// @param data pointer to decoded address and PDU
+/// @param length data length in bytes
+/// @return two's complement of the sum of bytes
+std::uint8_t calcLrc(const std::uint8_t* data, const size_t length);
+
+/// @brief RTU timing on the line
+struct FrameTiming
+{
+    /// @brief transmission time of one character
+    std::chrono::microseconds char_time{0};
+    /// @brief maximum silence between characters inside the frame
+    std::chrono::microseconds t15{0};
+    /// @brief minimum silence between frames
+    std::chrono::microseconds t35{0};
+};
+
+/// @brief calculate RTU timing for serial line parameters, fixed values are
+/// used above 19200 bd as recommended by Modbus serial line specification
+/// @param baudrate line baudrate
+/// @param bits_per_char start, data, parity and stop bits of one character
+/// @return timing, all zeros if baudrate is 0
+FrameTiming calcFrameTiming(const std::uint32_t baudrate, const int bits_per_char);
+
+enum class FrameDirection
+{
+    response, // server to client
+    request   // client to server
+};
+
+enum class ParserStatus
+{
+    incomplete,
+    complete,
+    error
+};
+
+/// @brief file record reference for multi-record file requests
+struct FileRecord
+{
+    std::uint16_t file_id = 0;
+    std::uint16_t record_id = 0;
+    /// @brief record data for write requests, not used for read requests
+    const std::uint8_t* data = nullptr;
+    /// @brief record length in bytes, even
+    std::uint16_t length = 0;
+};
+
+/// @brief fixed capacity buffer able to hold any ADU, used to avoid heap
+/// allocations on frame encoding
+class Frame
+{
+public:
+    std::uint8_t* data() { return buffer.data(); }
+    const std::uint8_t* data() const { return buffer.data(); }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    static constexpr size_t capacity() { return max_frame_size; }
+    void clear() { length = 0; }
+    /// @brief set actual frame length, used by encoder
+    /// @param new_length new length, truncated to capacity
+    void resize(const size_t new_length) { length = (new_length < capacity()) ? new_length : capacity(); }
+    std::uint8_t& operator[](const size_t index) { return buffer[index]; }
+    const std::uint8_t& operator[](const size_t index) const { return buffer[index]; }
+    const std::uint8_t* begin() const { return buffer.data(); }
+    const std::uint8_t* end() const { return buffer.data() + length; }
+
+private:
+    std::array<std::uint8_t, max_frame_size> buffer;
+    size_t length = 0;
+};
+
+/// @brief incremental parser for server responses (or client requests on
+/// server side), fed as bytes arrive; frame length is known from the function
+/// code (and byte count field), so frame completion is reported on the last
+/// byte without waiting for timeout; ASCII frames are decoded from hex on the
+/// fly, so the frame is always binary
+class FrameParser
+{
+public:
+    FrameParser() = default;
+    /// @brief prepare parser for a new frame
+    /// @param new_mode used Modbus mode
+    /// @param padding true if RTU frames are padded with zero bytes
+    /// @param new_direction direction of parsed frames
+    void reset(const ModbusMode new_mode, const bool padding = true, const FrameDirection new_direction = FrameDirection::response);
+    /// @brief prepare parser for a new frame in actual mode
+    void reset();
+    /// @brief feed one received byte
+    /// @param value received byte
+    /// @return parser status after this byte
+    ParserStatus push(const std::uint8_t value);
+    /// @brief feed received bytes, stops on frame completion or error
+    /// @param data pointer to received data
+    /// @param length data length in bytes
+    /// @return amount of bytes consumed
+    size_t push(const std::uint8_t* data, const size_t length);
+    /// @brief get amount of bytes which can be read from the line without
+    /// touching the next frame
+    /// @return bytes to read, 0 if frame is complete or broken
+    size_t getBytesToRead() const;
+    ParserStatus getStatus() const { return status; }
+    /// @brief get decoded frame without start and stop sequences: address,
+    /// PDU, crc (or LRC)
+    /// @return pointer to frame
+    const std::uint8_t* data() const { return frame.data(); }
+    /// @brief get decoded frame length without start and stop sequences
+    /// @return length in bytes
+    size_t size() const { return length; }
+    /// @brief get frame length with start and stop sequences, as it was sent
+    /// @return length in bytes
+    size_t getAduSize() const;
+    /// @brief check if frame has not started since reset, skipped start
+    /// sequence bytes and stop sequence of previous frame are not counted
+    /// @return true if no frame bytes received
+    bool empty() const { return !started; }
+    /// @brief check if frame is a server exception response
+    /// @return true if exception bit is set in function code
+    bool isException() const;
+    /// @brief check frame crc (or LRC), frame must be complete
+    /// @return true in case of success
+    bool isChecksumValid() const;
+
+private:
+    ModbusMode mode = ModbusMode::rtu;
+    bool rtu_padding = true;
+    FrameDirection direction = FrameDirection::response;
+    ParserStatus status = ParserStatus::incomplete;
+    std::array<std::uint8_t, max_frame_size> frame;
+    /// @brief actual frame length
+    size_t length = 0;
+    /// @brief expected frame length, 0 until known
+    size_t expected = 0;
+    /// @brief amount of received stop sequence bytes
+    size_t stop_received = 0;
+    bool started = false;
+    /// @brief first hex character of ASCII byte waiting for the second one
+    std::uint8_t pending_char = 0;
+    bool char_pending = false;
+    /// @brief store decoded byte and update expected length
+    /// @param value decoded byte
+    void store(const std::uint8_t value);
+    /// @brief feed one ASCII character after start
+    /// @param value received character
+    void pushAscii(const std::uint8_t value);
+    /// @brief calculate expected frame length from received header
+    void updateExpectedLength();
+    /// @brief calculate expected request length from received header
+    void updateExpectedRequestLength();
 };
 
 class ModbusClient
@@ -52,6 +223,11 @@ public:
     ModbusClient() = default;
     ModbusMode getMode() const { return mode; };
     void setMode(const ModbusMode new_mode) { mode = new_mode; };
+    /// @brief RTU frames are padded with zero bytes on both sides by default,
+    /// not needed if line silence is kept with FrameTiming
+    /// @param enabled true to pad frames
+    void setRtuPadding(const bool enabled) { rtu_padding = enabled; };
+    bool getRtuPadding() const { return rtu_padding; };
     /// @brief create custom message
     /// @param addr server address
     /// @param func function code
@@ -87,6 +263,14 @@ public:
     std::vector<std::uint8_t>& msgWriteRegister(const std::uint8_t addr,
                                                 const std::uint16_t reg,
                                                 const std::uint16_t value);
+    /// @brief write data to several contiguous registers according to Modbus
+    /// @param addr server address
+    /// @param reg start address
+    /// @param values vector with half words to write
+    /// @return reference to vector with created message
+    std::vector<std::uint8_t>& msgWriteRegisters(const std::uint8_t addr,
+                                                 const std::uint16_t reg,
+                                                 const std::vector<std::uint16_t>& values);
     /// @brief read holding registers according to Modbus protocol
     /// @param addr server address
     /// @param reg register start address
@@ -95,6 +279,107 @@ public:
     std::vector<std::uint8_t>& msgReadRegisters(const std::uint8_t addr,
                                                 const std::uint16_t reg,
                                                 const std::uint16_t quantity);
+    /// @brief encode custom message into caller buffer
+    /// @param frame buffer to write ADU to
+    /// @param addr server address
+    /// @param func function code
+    /// @param data pointer to data for PDU
+    /// @param length data length in bytes
+    /// @return ADU length, 0 if it does not fit into buffer
+    size_t encodeCustom(Frame& frame, const std::uint8_t addr,
+                        const std::uint8_t func, const std::uint8_t* data,
+                        const size_t length) const;
+    /// @brief encode write file record message into caller buffer
+    /// @param frame buffer to write ADU to
+    /// @param addr server address
+    /// @param file_id file id
+    /// @param record_id record id
+    /// @param record_data pointer to record data
+    /// @param length record data length in bytes
+    /// @return ADU length, 0 if it does not fit into buffer
+    size_t encodeWriteFileRecord(Frame& frame, const std::uint8_t addr,
+                                 const std::uint16_t file_id,
+                                 const std::uint16_t record_id,
+                                 const std::uint8_t* record_data,
+                                 const size_t length) const;
+    /// @brief encode write file record message with several sub-requests
+    /// @param frame buffer to write ADU to
+    /// @param addr server address
+    /// @param records pointer to records to write
+    /// @param count amount of records
+    /// @return ADU length, 0 if records do not fit into one PDU
+    size_t encodeWriteFileRecords(Frame& frame, const std::uint8_t addr,
+                                  const FileRecord* records,
+                                  const size_t count) const;
+    /// @brief encode read file record message with several sub-requests
+    /// @param frame buffer to write ADU to
+    /// @param addr server address
+    /// @param records pointer to records to read
+    /// @param count amount of records
+    /// @return ADU length, 0 if records or their response do not fit into one PDU
+    size_t encodeReadFileRecords(Frame& frame, const std::uint8_t addr,
+                                 const FileRecord* records,
+                                 const size_t count) const;
+    /// @brief get maximum amount of records of the same size which fit into
+    /// one file record request and its response
+    /// @param code FunctionCodes::read_file or FunctionCodes::write_file
+    /// @param record_size record length in bytes
+    /// @return amount of records, 0 if even one record does not fit
+    static size_t getMaxFileRecords(const FunctionCodes code, const size_t record_size);
+    /// @brief encode read file record message into caller buffer
+    /// @param frame buffer to write ADU to
+    /// @param addr server address
+    /// @param file_id file id
+    /// @param record_id record id
+    /// @param length record length in half words
+    /// @return ADU length, 0 if it does not fit into buffer
+    size_t encodeReadFileRecord(Frame& frame, const std::uint8_t addr,
+                                const std::uint16_t file_id,
+                                const std::uint16_t record_id,
+                                const std::uint16_t length) const;
+    /// @brief encode write single register message into caller buffer
+    /// @param frame buffer to write ADU to
+    /// @param addr server address
+    /// @param reg register address
+    /// @param value half word to write
+    /// @return ADU length, 0 if it does not fit into buffer
+    size_t encodeWriteRegister(Frame& frame, const std::uint8_t addr,
+                               const std::uint16_t reg,
+                               const std::uint16_t value) const;
+    /// @brief encode write multiple registers message into caller buffer
+    /// @param frame buffer to write ADU to
+    /// @param addr server address
+    /// @param reg register start address
+    /// @param values pointer to half words to write
+    /// @param quantity amount of registers to write
+    /// @return ADU length, 0 if quantity is out of Modbus limits
+    size_t encodeWriteRegisters(Frame& frame, const std::uint8_t addr,
+                                const std::uint16_t reg,
+                                const std::uint16_t* values,
+                                const size_t quantity) const;
+    /// @brief encode read holding registers message into caller buffer
+    /// @param frame buffer to write ADU to
+    /// @param addr server address
+    /// @param reg register start address
+    /// @param quantity amount of registers to read
+    /// @return ADU length, 0 if it does not fit into buffer
+    size_t encodeReadRegisters(Frame& frame, const std::uint8_t addr,
+                               const std::uint16_t reg,
+                               const std::uint16_t quantity) const;
+    /// @brief change server address of encoded ADU in place, crc (or LRC) is
+    /// patched for the new address without reading PDU
+    /// @param adu ADU encoded in actual mode with valid crc
+    /// @param size ADU length in bytes
+    /// @param addr new server address
+    /// @return false if ADU is too short for actual mode
+    bool restampAddress(std::uint8_t* adu, const size_t size, const std::uint8_t addr) const;
+    /// @brief decode the beginning of address and PDU of encoded ADU
+    /// @param adu ADU encoded in actual mode
+    /// @param size ADU length in bytes
+    /// @param message pointer to save decoded bytes to
+    /// @param length amount of bytes to decode
+    /// @return false if ADU is too short or ASCII characters are not hex digits
+    bool decodeMessageHead(const std::uint8_t* adu, const size_t size, std::uint8_t* message, const size_t length) const;
     /// @brief checking if Modbus package checksum is valid
     /// @param data vector with package to check
     /// @return true in case of success
@@ -107,21 +392,22 @@ public:
     /// @brief get actual length of ADU- PDU
     /// @return length in bytes
     std::uint8_t getRequriedLength() const;
+    /// @brief get ADU length in actual mode, ASCII PDU takes two characters
+    /// per byte
+    /// @param pdu_size PDU length in bytes
+    /// @return length in bytes
+    size_t getAduSize(const size_t pdu_size) const;
 
 private:
     ModbusMode mode = ModbusMode::rtu;
+    bool rtu_padding = true;
     /// @brief internal message buffer, used to store last created message
     std::vector<std::uint8_t> buffer;
-    /// @brief generate ADU on internal buffer
-    /// @param addr server address
-    /// @param func function code
-    /// @param data vector with data for PDU
-    void createMessage(const std::uint8_t addr, const std::uint8_t func,
-                       const std::vector<std::uint8_t>& data);
-    /// @brief calculate crc16
-    /// @param data vector with data to calculate crc
-    /// @return calculated crc
-    std::uint16_t crc16(const std::vector<std::uint8_t>& data);
+    /// @brief internal frame used by vector based interface
+    Frame frame;
+    /// @brief copy internal frame to internal message buffer
+    /// @return reference to internal message buffer
+    std::vector<std::uint8_t>& frameToBuffer();
 };
 } // namespace modbus
 
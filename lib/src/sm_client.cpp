@@ -8,16 +8,76 @@
  */
 
 #include "../inc/sm_client.hpp"
+#include "../inc/sm_crc.hpp"
 #include <algorithm>
+#include <array>
 #include <cstring>
+#include <deque>
 #include <iostream>
+#include <iterator>
+
+namespace
+{
+std::uint32_t getBaudrate(const sp::PortBaudRate baudrate)
+{
+    switch (baudrate)
+    {
+        case sp::PortBaudRate::BD_9600:
+            return 9600;
+
+        case sp::PortBaudRate::BD_19200:
+            return 19200;
+
+        case sp::PortBaudRate::BD_38400:
+            return 38400;
+
+        case sp::PortBaudRate::BD_57600:
+            return 57600;
+
+        case sp::PortBaudRate::BD_115200:
+            return 115200;
+    }
+    return 0;
+}
+
+int getBitsPerChar(const sp::PortConfig& config)
+{
+    const int start_bits = 1;
+    int data_bits = 8;
+    switch (config.data_bits)
+    {
+        case sp::PortDataBits::Five:
+            data_bits = 5;
+            break;
+
+        case sp::PortDataBits::Six:
+            data_bits = 6;
+            break;
+
+        case sp::PortDataBits::Seven:
+            data_bits = 7;
+            break;
+
+        case sp::PortDataBits::Eight:
+            data_bits = 8;
+            break;
+    }
+    const int parity_bits = (config.parity == sp::PortParity::None) ? 0 : 1;
+    const int stop_bits = (config.stop_bits == sp::PortStopBits::Two) ? 2 : 1;
+    return start_bits + data_bits + parity_bits + stop_bits;
+}
+} // namespace
 
 namespace sm
 {
 
 Client::~Client()
 {
-    thread_stop.store(true, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(task_queue_mutex);
+        thread_stop.store(true, std::memory_order_relaxed);
+    }
+    task_queue_cv.notify_one();
     client_thread.join();
 }
 
@@ -47,9 +107,19 @@ void Client::addServer(const std::uint8_t addr, const std::uint8_t gateway_addr)
     }
 }
 
+void Client::setTransferWindow(const std::uint8_t address, const int window)
+{
+    int index = getServerIndex(address);
+    if (index != -1)
+    {
+        servers[index].info.transfer_window = std::clamp(window, 1, max_transfer_window);
+    }
+}
+
 std::error_code Client::start(std::string device)
 {
     task_info.error_code = std::error_code();
+    gateway_buffer_sizes.clear();
     if (serial_port.getState() != sp::PortState::Open)
     {
         task_info.error_code = serial_port.open(device);
@@ -62,6 +132,11 @@ std::error_code Client::start(std::string device)
             task_info.error_code = serial_port.open(device);
         }
     }
+    if (!task_info.error_code)
+    {
+        // keep bytes received beyond actual frame, they belong to the next one
+        serial_port.port.setBufferedMode(true);
+    }
     return task_info.error_code;
 }
 
@@ -77,15 +152,24 @@ void Client::stop()
 std::error_code Client::configure(sp::PortConfig config)
 {
     task_info.error_code = serial_port.setup(config);
+    if (!task_info.error_code)
+    {
+        frame_timing = modbus::calcFrameTiming(getBaudrate(config.baudrate), getBitsPerChar(config));
+    }
     return task_info.error_code;
 }
 
 std::error_code Client::connect(const std::uint8_t address)
 {
-    // flush port buffer first
-    serial_port.port.flushPort();
     task_info.error_code = make_error_code(ClientErrors::server_not_connected);
-    
+    // server may have been restarted, do not rely on its gateway state
+    int index = getServerIndex(address);
+    if (index != -1)
+    {
+        gateway_buffer_sizes.erase(address);
+        gateway_buffer_sizes.erase(servers[index].info.gateway_addr);
+    }
+
     // (1) ping server, expected answer with exception type 1
     task_info.error_code = taskPing(address);
     if (task_info.error_code)
@@ -118,13 +202,16 @@ std::error_code Client::connect(const std::uint8_t address)
 
 void Client::disconnect()
 {
-
+    gateway_buffer_sizes.clear();
 }
 
 std::error_code Client::eraseApp(const std::uint8_t address)
 {
-    // flush port buffer first
-    serial_port.port.flushPort();
+    // records written before are lost even if erase response does not arrive
+    if (!journal_directory.empty())
+    {
+        Journal::discard(journal_directory, serial_port.getPath(), address);
+    }
     // (1) erase request
     // we may have here timeout problem because flash erase take a lot of time in some cases, add additional logic for this case in future
     task_info.error_code = taskWriteRegister(address, static_cast<std::uint16_t>(ServerRegisters::app_erase), app_erase_request);
@@ -132,6 +219,7 @@ std::error_code Client::eraseApp(const std::uint8_t address)
     {
         return task_info.error_code;
     }
+    servers[getServerIndex(address)].info.erased = true;
     // (2) read register with status information
     task_info.error_code = taskReadRegisters(address, modbus::holding_regs_offset, amount_of_regs);
     if (task_info.error_code)
@@ -143,8 +231,6 @@ std::error_code Client::eraseApp(const std::uint8_t address)
 
 std::error_code Client::uploadApp(const std::uint8_t address, const std::string path_to_file)
 {
-    // flush port buffer first
-    serial_port.port.flushPort();
     task_info.error_code = make_error_code(ClientErrors::server_not_connected);
     int index = getServerIndex(address);
     if (index == -1)
@@ -152,38 +238,149 @@ std::error_code Client::uploadApp(const std::uint8_t address, const std::string
         return task_info.error_code;
     }
     std::uint8_t record_size = servers[index].regs[static_cast<std::uint8_t>(ServerRegisters::record_size)];
+    uploaded_bytes = 0;
     // (1) load full firmware file into vector
     if (file.fileExternalWriteSetup(static_cast<std::uint16_t>(ServerFiles::application), path_to_file, record_size))
     {
-        // (2) send new file size
-        std::uint16_t num_of_records = file.getNumOfRecords();
-        task_info.error_code = taskWriteRegister(address, static_cast<std::uint16_t>(ServerRegisters::app_size), num_of_records);
+        // (2) compare with the application held by the server, if any
+        unchanged_records.clear();
+        if (delta_upload && (servers[index].regs[static_cast<int>(ServerRegisters::boot_status)] == static_cast<std::uint16_t>(BootloaderStatus::ready)))
+        {
+            if (findUnchangedRecords(address))
+            {
+                std::printf("checksums of server records are not available, full upload \n");
+                unchanged_records.clear();
+            }
+        }
+        else if (sparse_upload && servers[index].info.erased)
+        {
+            // erased flash already holds blank records
+            unchanged_records = file.getBlankRecords();
+        }
+        // the last record completes the image on the server, it is always sent
+        if (!unchanged_records.empty())
+        {
+            unchanged_records.back() = false;
+        }
+        // any upload attempt leaves records of its image on the server
+        servers[index].info.erased = false;
+        // (2.1) check what is left from interrupted upload of the same image
+        if (!journal_directory.empty())
+        {
+            openUploadJournal(address, record_size);
+        }
+        // (3, 4) send new file size, prepare to write
+        task_info.error_code = taskPrepareUpload(address);
         if (task_info.error_code)
         {
+            journal.close();
             return task_info.error_code;
         }
-        // (3) prepare to write
-        task_info.error_code = taskWriteRegister(address, static_cast<std::uint16_t>(ServerRegisters::file_control), file_write_prepare);
+        // (5) file sending, journal is kept for the next attempt in case of error
+        task_info.error_code = taskWriteFile(address);
         if (task_info.error_code)
         {
+            journal.close();
             return task_info.error_code;
         }
-        // (4) file sending
-        task_info.error_code = taskWriteFile(address);
+        journal.remove();
+        // (6) read status back, extended registers are read from servers holding large image only
+        servers[index].regs[static_cast<int>(ServerRegisters::app_size_high)] = 0;
+        task_info.error_code = taskReadRegisters(address, modbus::holding_regs_offset,
+                                                 (file.getNumOfRecords() > modbus::max_num_of_records) ? (amount_of_regs + amount_of_ext_regs) : amount_of_regs);
+    }
+    return task_info.error_code;
+}
+
+std::error_code Client::uploadAppBroadcast(const std::vector<std::uint8_t>& addresses, const std::string path_to_file)
+{
+    task_info.error_code = make_error_code(ClientErrors::server_not_connected);
+    if (addresses.empty())
+    {
+        return task_info.error_code;
+    }
+    std::vector<int> indexes;
+    for (const std::uint8_t address : addresses)
+    {
+        const int index = getServerIndex(address);
+        if (index == -1)
+        {
+            return task_info.error_code;
+        }
+        indexes.push_back(index);
+    }
+    const std::uint16_t record_size = servers[indexes.front()].regs[static_cast<int>(ServerRegisters::record_size)];
+    for (const int index : indexes)
+    {
+        // gateways do not pass broadcast, padding starts with the same zero as broadcast address
+        if ((servers[index].info.gateway_addr != 0) || (servers[index].regs[static_cast<int>(ServerRegisters::record_size)] != record_size) ||
+            ((modbus_client.getMode() == modbus::ModbusMode::rtu) && modbus_client.getRtuPadding()))
+        {
+            task_info.error_code = make_error_code(ClientErrors::broadcast_not_supported);
+            return task_info.error_code;
+        }
+    }
+    uploaded_bytes = 0;
+    // (1) load full firmware file
+    if (!file.fileExternalWriteSetup(static_cast<std::uint16_t>(ServerFiles::application), path_to_file, static_cast<std::uint8_t>(record_size)))
+    {
+        return task_info.error_code;
+    }
+    // (2) every server is prepared by unicast, so it is known to be ready for broadcast
+    for (const int index : indexes)
+    {
+        servers[index].info.erased = false;
+        task_info.error_code = taskPrepareUpload(servers[index].info.addr);
         if (task_info.error_code)
         {
             return task_info.error_code;
         }
-        // (5) read status back
-        task_info.error_code = taskReadRegisters(address, modbus::holding_regs_offset, amount_of_regs);
     }
+    // (3) all records at once, nobody responds
+    unchanged_records.clear();
+    task_info.error_code = taskBroadcastFile(record_size);
+    if (task_info.error_code)
+    {
+        return task_info.error_code;
+    }
+    // (4) every server is checked, missing records are sent again
+    std::error_code first_error;
+    for (const std::uint8_t address : addresses)
+    {
+        if (findUnchangedRecords(address))
+        {
+            std::printf("checksums of server %d records are not available, full upload \n", address);
+            unchanged_records.clear();
+        }
+        // the last record completes the image on the server, it is always sent
+        if (!unchanged_records.empty())
+        {
+            unchanged_records.back() = false;
+        }
+        std::error_code error = taskWriteRegister(address, static_cast<std::uint16_t>(ServerRegisters::file_control), file_write_prepare);
+        if (!error)
+        {
+            error = taskWriteFile(address);
+        }
+        if (!error)
+        {
+            servers[getServerIndex(address)].regs[static_cast<int>(ServerRegisters::app_size_high)] = 0;
+            error = taskReadRegisters(address, modbus::holding_regs_offset,
+                                      (file.getNumOfRecords() > modbus::max_num_of_records) ? (amount_of_regs + amount_of_ext_regs) : amount_of_regs);
+        }
+        if (error)
+        {
+            std::printf("failed to upload firmware to server %d: %s \n", address, error.message().c_str());
+            first_error = first_error ? first_error : error;
+        }
+    }
+    unchanged_records.clear();
+    task_info.error_code = first_error;
     return task_info.error_code;
 }
 
 std::error_code Client::startApp(const std::uint8_t address)
 {
-    // flush port buffer first
-    serial_port.port.flushPort();
     task_info.error_code = taskWriteRegister(address, static_cast<std::uint16_t>(ServerRegisters::app_start), app_start_request);
     return task_info.error_code;
 }
@@ -193,10 +390,10 @@ std::error_code Client::taskPing(const std::uint8_t dev_addr)
     auto lambda_ping = [this](const std::uint8_t address)
     {
         std::uint8_t function = static_cast<uint8_t>(modbus::FunctionCodes::undefined);
-        std::vector<uint8_t> message{0x00, 0x00, 0x00, 0x00};
-        request_data = modbus_client.msgCustom(address, function, message);
+        const std::uint8_t message[] = {0x00, 0x00, 0x00, 0x00};
+        modbus_client.encodeCustom(request_data, address, function, message, sizeof(message));
         // 1 byte for exception + 1 byte for func + modbus required part
-        TaskAttributes attr = TaskAttributes(modbus::FunctionCodes::undefined, static_cast<size_t>(modbus_client.getRequriedLength() + 2));
+        TaskAttributes attr = TaskAttributes(modbus::FunctionCodes::undefined, modbus_client.getAduSize(2));
         createServerRequest(attr);
     };
 
@@ -209,7 +406,7 @@ std::error_code Client::taskPing(const std::uint8_t dev_addr)
     // we are trying to reach this server through the gateway, perform gateway setup first
     if (servers[index].info.gateway_addr != 0)
     {
-        std::uint16_t expected_length = modbus_client.getRequriedLength() + 2;
+        std::uint16_t expected_length = modbus_client.getAduSize(2);
         std::uint16_t control_reg = static_cast<std::uint16_t>(ServerRegisters::gateway_buffer_size);
         auto error = taskWriteRegister(servers[index].info.gateway_addr, control_reg, expected_length);
         if (error)
@@ -220,18 +417,16 @@ std::error_code Client::taskPing(const std::uint8_t dev_addr)
     }
     // direct address ping
     task_info.reset(ClientTasks::ping, 1, index);
-    q_task.push([this, lambda_ping, dev_addr]() { q_exchange.push([lambda_ping, dev_addr] { lambda_ping(dev_addr); }); });
-    while (!task_info.done)
-        ;
-    return task_info.error_code;
+    pushTask([this, lambda_ping, dev_addr]() { q_exchange.push([lambda_ping, dev_addr] { lambda_ping(dev_addr); }); });
+    return waitTaskDone();
 }
 
-std::error_code Client::taskWriteRegister(const std::uint8_t dev_addr, const std::uint16_t reg_addr, const std::uint16_t value)
+std::error_code Client::taskWriteRegister(const std::uint8_t dev_addr, const std::uint16_t reg_addr, const std::uint16_t value,
+                                          const bool gateway_setup)
 {
-    static bool recurced = false;
     auto lambda_write_reg = [this](const std::uint8_t dev_addr, const std::uint16_t reg_addr, const std::uint16_t value)
     {
-        request_data = modbus_client.msgWriteRegister(dev_addr, reg_addr, value);
+        modbus_client.encodeWriteRegister(request_data, dev_addr, reg_addr, value);
         // in case of success we expect message with the same length
         TaskAttributes attr = TaskAttributes(modbus::FunctionCodes::write_register, request_data.size());
         createServerRequest(attr);
@@ -242,39 +437,131 @@ std::error_code Client::taskWriteRegister(const std::uint8_t dev_addr, const std
     {
         return task_info.error_code;
     }
+    // gateway already holds this buffer size, nothing to write
+    if (isGatewayBufferSizeSet(dev_addr, reg_addr, value))
+    {
+        task_info.error_code = std::error_code();
+        return task_info.error_code;
+    }
     // we are trying to reach this server through the gateway, perform gateway setup first
-    if ((servers[index].info.gateway_addr != 0) && !recurced)
+    if ((servers[index].info.gateway_addr != 0) && gateway_setup)
     {
-        recurced = true;
-        std::uint16_t expected_length = modbus_client.getRequriedLength() + 5;
+        std::uint16_t expected_length = modbus_client.getAduSize(5);
         std::uint16_t control_reg = static_cast<std::uint16_t>(ServerRegisters::gateway_buffer_size);
         std::printf("recursive call \n");
-        auto error = taskWriteRegister(servers[index].info.gateway_addr, control_reg, expected_length);
+        auto error = taskWriteRegister(servers[index].info.gateway_addr, control_reg, expected_length, false);
         if (error)
         {
             task_info.error_code = make_error_code(ClientErrors::gateway_not_responding);
-            recurced = false;
             return task_info.error_code;
         }
     }
 
     // direct register write
     task_info.reset(ClientTasks::reg_write, 1,index);
-    q_task.push([this, lambda_write_reg, dev_addr, reg_addr, value]()
+    pushTask([this, lambda_write_reg, dev_addr, reg_addr, value]()
                 { q_exchange.push([lambda_write_reg, dev_addr, reg_addr, value] { lambda_write_reg(dev_addr, reg_addr, value); }); });
-    while (!task_info.done)
-        ;
-    recurced = false;
-    return task_info.error_code;
+    auto error = waitTaskDone();
+    if (!error && (reg_addr == static_cast<std::uint16_t>(ServerRegisters::gateway_buffer_size)))
+    {
+        gateway_buffer_sizes[dev_addr] = value;
+    }
+    return error;
+}
+
+std::error_code Client::taskWriteRegisters(const std::uint8_t dev_addr, const RegisterWrite* writes, const size_t count)
+{
+    auto lambda_write_regs = [this](const std::uint8_t dev_addr, const std::uint16_t reg_addr, const std::vector<std::uint16_t>& values)
+    {
+        TaskAttributes attr;
+        if (values.size() == 1)
+        {
+            modbus_client.encodeWriteRegister(request_data, dev_addr, reg_addr, values[0]);
+            // in case of success we expect message with the same length
+            attr = TaskAttributes(modbus::FunctionCodes::write_register, request_data.size());
+        }
+        else
+        {
+            modbus_client.encodeWriteRegisters(request_data, dev_addr, reg_addr, values.data(), values.size());
+            // 2 bytes for start address + 2 bytes for quantity + 1 byte for func + modbus required part
+            attr = TaskAttributes(modbus::FunctionCodes::write_registers, modbus_client.getAduSize(5));
+        }
+        createServerRequest(attr);
+    };
+    task_info.error_code = make_error_code(ClientErrors::server_not_connected);
+    int index = getServerIndex(dev_addr);
+    if ((index == -1) || (count == 0))
+    {
+        return task_info.error_code;
+    }
+
+    // sort by register address, stable to keep the last write to the same register
+    std::vector<RegisterWrite> sorted(writes, writes + count);
+    std::stable_sort(sorted.begin(), sorted.end(), [](const RegisterWrite& a, const RegisterWrite& b) { return a.reg < b.reg; });
+    std::vector<std::pair<std::uint16_t, std::vector<std::uint16_t>>> runs;
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        if ((((i + 1) < sorted.size()) && (sorted[i + 1].reg == sorted[i].reg)) ||
+            isGatewayBufferSizeSet(dev_addr, sorted[i].reg, sorted[i].value))
+        {
+            continue;
+        }
+        if (runs.empty() || (sorted[i].reg != (runs.back().first + runs.back().second.size())) ||
+            (runs.back().second.size() == static_cast<size_t>(modbus::max_write_registers)))
+        {
+            runs.emplace_back(sorted[i].reg, std::vector<std::uint16_t>());
+        }
+        runs.back().second.push_back(sorted[i].value);
+    }
+    if (runs.empty())
+    {
+        task_info.error_code = std::error_code();
+        return task_info.error_code;
+    }
+
+    // we are trying to reach this server through the gateway, perform gateway setup first,
+    // single and multiple registers write responses have the same length
+    if (servers[index].info.gateway_addr != 0)
+    {
+        std::uint16_t expected_length = modbus_client.getAduSize(5);
+        std::uint16_t control_reg = static_cast<std::uint16_t>(ServerRegisters::gateway_buffer_size);
+        auto error = taskWriteRegister(servers[index].info.gateway_addr, control_reg, expected_length);
+        if (error)
+        {
+            task_info.error_code = make_error_code(ClientErrors::gateway_not_responding);
+            return task_info.error_code;
+        }
+    }
+
+    // one exchange for every run of adjacent registers
+    task_info.reset(ClientTasks::reg_write, static_cast<int>(runs.size()), index);
+    pushTask(
+        [this, lambda_write_regs, dev_addr, runs]()
+        {
+            for (const auto& run : runs)
+            {
+                q_exchange.push([lambda_write_regs, dev_addr, run] { lambda_write_regs(dev_addr, run.first, run.second); });
+            }
+        });
+    auto error = waitTaskDone();
+    const std::uint16_t buffer_size_reg = static_cast<std::uint16_t>(ServerRegisters::gateway_buffer_size);
+    for (const auto& run : runs)
+    {
+        if (!error && (buffer_size_reg >= run.first) && (buffer_size_reg < (run.first + run.second.size())))
+        {
+            gateway_buffer_sizes[dev_addr] = run.second[buffer_size_reg - run.first];
+        }
+    }
+    return error;
 }
 
 std::error_code Client::taskReadRegisters(const std::uint8_t dev_addr, const std::uint16_t reg_addr, const std::uint16_t quantity)
 {
     auto lambda_read_regs = [this](const std::uint8_t dev_addr, const std::uint16_t reg_addr, const std::uint16_t quantity)
     {
-        request_data = modbus_client.msgReadRegisters(dev_addr, reg_addr, quantity);
+        modbus_client.encodeReadRegisters(request_data, dev_addr, reg_addr, quantity);
         // amount of 16 bit registers + 1 byte for length + 1 byte for func + modbus required part
-        size_t expected_length = static_cast<size_t>(modbus_client.getRequriedLength() + (quantity * 2) + 2);
+        size_t expected_length = modbus_client.getAduSize((quantity * 2) + 2);
         TaskAttributes attr = TaskAttributes(modbus::FunctionCodes::read_registers, expected_length);
         createServerRequest(attr);
     };
@@ -287,7 +574,7 @@ std::error_code Client::taskReadRegisters(const std::uint8_t dev_addr, const std
     // we are trying to reach this server through the gateway, perform gateway setup first
     if (servers[index].info.gateway_addr != 0)
     {
-        std::uint16_t expected_length = static_cast<size_t>(modbus_client.getRequriedLength() + (quantity * 2) + 2);
+        std::uint16_t expected_length = modbus_client.getAduSize((quantity * 2) + 2);
         std::uint16_t control_reg = static_cast<std::uint16_t>(ServerRegisters::gateway_buffer_size);
         auto error = taskWriteRegister(servers[index].info.gateway_addr, control_reg, expected_length);
         if (error)
@@ -298,35 +585,41 @@ std::error_code Client::taskReadRegisters(const std::uint8_t dev_addr, const std
     }
     // direct registers reading
     task_info.reset(ClientTasks::regs_read, 1, index);
-    q_task.push([this, lambda_read_regs, dev_addr, reg_addr, quantity]()
+    pushTask([this, lambda_read_regs, dev_addr, reg_addr, quantity]()
                 { q_exchange.push([lambda_read_regs, dev_addr, reg_addr, quantity] { lambda_read_regs(dev_addr, reg_addr, quantity); }); });
-    while (!task_info.done)
-        ;
-    return task_info.error_code;
+    return waitTaskDone();
 }
 
 std::error_code Client::taskReadFile(const std::uint8_t dev_addr, const ServerFiles file_id)
 {
-    auto lambda_read_record = [this](const std::uint8_t dev_addr, const std::uint16_t file_id, const std::uint16_t record_id, const std::uint16_t length)
+    auto lambda_read_records = [this](const std::uint8_t dev_addr, const std::uint16_t file_id, const int first_record, const int num_of_records)
     {
-        request_data = modbus_client.msgReadFileRecord(dev_addr, file_id, record_id, length);
-        // amount of half words + 1 byte for ref type + 1 byte for data length
-        // + 1 byte for resp length + 1 byte for func + modbus required part
-        size_t expected_length = static_cast<size_t>(modbus_client.getRequriedLength() + (length * 2) + 4);
-        TaskAttributes attr = TaskAttributes(modbus::FunctionCodes::read_file, expected_length);
+        std::array<modbus::FileRecord, modbus::max_file_records> records;
+        // 1 byte for resp length + 1 byte for func
+        size_t pdu_size = 2;
+        for (int i = 0; i < num_of_records; ++i)
+        {
+            records[i].file_id = file_id;
+            records[i].record_id = getRecordId(first_record + i);
+            records[i].length = file.getActualRecordLength(first_record + i);
+            // 1 byte for data length + 1 byte for ref type + record data
+            pdu_size += records[i].length + 2;
+        }
+        modbus_client.encodeReadFileRecords(request_data, dev_addr, records.data(), num_of_records);
+        TaskAttributes attr = TaskAttributes(modbus::FunctionCodes::read_file, modbus_client.getAduSize(pdu_size));
+        attr.record = first_record;
+        attr.num_of_records = num_of_records;
         createServerRequest(attr);
     };
 
-    auto lambda_read_file =
-        [this, lambda_read_record](const std::uint8_t dev_addr,const int index, const std::uint16_t file_id)
+    auto lambda_read_file = [this, lambda_read_records](const std::uint8_t dev_addr, const int index, const std::uint16_t file_id,
+                                                        const int first_record, const int last_record, const int records_per_exchange)
     {
-        auto num_of_records = file.getNumOfRecords();
-        task_info.reset(ClientTasks::file_read, num_of_records, index);
-        for (auto i = 0; i < num_of_records; ++i)
+        task_info.reset(ClientTasks::file_read, (last_record - first_record + records_per_exchange - 1) / records_per_exchange, index);
+        for (int i = first_record; i < last_record; i += records_per_exchange)
         {
-            auto words_in_record = file.getActualRecordLength(i) / 2;
-            q_exchange.push([words_in_record, file_id, i, lambda_read_record, dev_addr]
-                            { lambda_read_record(dev_addr, file_id, static_cast<std::uint16_t>(i), words_in_record); });
+            const int count = std::min(records_per_exchange, last_record - i);
+            q_exchange.push([lambda_read_records, dev_addr, file_id, i, count] { lambda_read_records(dev_addr, file_id, i, count); });
         }
     };
 
@@ -339,70 +632,110 @@ std::error_code Client::taskReadFile(const std::uint8_t dev_addr, const ServerFi
 
     auto record_size = servers[index].regs[static_cast<int>(ServerRegisters::record_size)];
     auto converted_file_id = static_cast<std::uint16_t>(file_id);
-    auto file_size = getFileSize(file_id);
+    auto file_size = getFileSize(file_id, servers[index]);
     if(file.fileReadSetup(converted_file_id, file_size, record_size) != true)
     {
         task_info.error_code = make_error_code(ClientErrors::server_not_connected);
         return task_info.error_code;
     }
 
-    // we are trying to reach this server through the gateway, perform gateway setup first
-    if (servers[index].info.gateway_addr != 0)
+    const int records_per_exchange = getRecordsPerExchange(modbus::FunctionCodes::read_file, record_size);
+    const int num_of_records = file.getNumOfRecords();
+    // file is read bank by bank, there is the only one for files up to max_num_of_records records
+    int first_record = 0;
+    do
     {
-        std::uint16_t expected_length = static_cast<size_t>(modbus_client.getRequriedLength() + record_size + 4);
-        std::uint16_t control_reg = static_cast<std::uint16_t>(ServerRegisters::gateway_buffer_size);
-        auto error = taskWriteRegister(servers[index].info.gateway_addr, control_reg, expected_length);
-        if (error)
+        const int last_record = std::min(num_of_records, first_record + modbus::max_num_of_records);
+        task_info.error_code = taskSetFileBank(dev_addr, first_record);
+        if (task_info.error_code)
         {
-            task_info.error_code = make_error_code(ClientErrors::gateway_not_responding);
             return task_info.error_code;
         }
-        control_reg = static_cast<std::uint16_t>(ServerRegisters::record_counter);
-        error = taskWriteRegister(servers[index].info.gateway_addr, control_reg, file.getNumOfRecords());
-        if (error)
+        // we are trying to reach this server through the gateway, perform gateway setup first
+        if (servers[index].info.gateway_addr != 0)
         {
-            task_info.error_code = make_error_code(ClientErrors::gateway_not_responding);
-            return task_info.error_code;
+            std::uint16_t expected_length = modbus_client.getAduSize(2 + records_per_exchange * (record_size + 2));
+            // gateway control registers are adjacent, they are written in one request
+            const RegisterWrite gateway_setup[] = {
+                {static_cast<std::uint16_t>(ServerRegisters::gateway_buffer_size), expected_length},
+                {static_cast<std::uint16_t>(ServerRegisters::record_counter), static_cast<std::uint16_t>(last_record - first_record)},
+                {static_cast<std::uint16_t>(ServerRegisters::gateway_file_control), file_read_prepare}};
+            auto error = taskWriteRegisters(servers[index].info.gateway_addr, gateway_setup, std::size(gateway_setup));
+            if (error)
+            {
+                task_info.error_code = make_error_code(ClientErrors::gateway_not_responding);
+                return task_info.error_code;
+            }
         }
-
-        control_reg = static_cast<std::uint16_t>(ServerRegisters::gateway_file_control);
-        error = taskWriteRegister(servers[index].info.gateway_addr, control_reg, file_read_prepare);
-        if (error)
+        task_info.reset();
+        pushTask([dev_addr, index, lambda_read_file, converted_file_id, first_record, last_record, records_per_exchange]()
+                 { lambda_read_file(dev_addr, index, converted_file_id, first_record, last_record, records_per_exchange); });
+        if (waitTaskDone())
         {
-            task_info.error_code = make_error_code(ClientErrors::gateway_not_responding);
             return task_info.error_code;
         }
-    }
-    task_info.reset();
-    q_task.push([this, dev_addr,index, lambda_read_file, converted_file_id]()
-                { lambda_read_file(dev_addr,index, converted_file_id); });
-    while (!task_info.done)
-        ;
+        first_record = last_record;
+    } while (first_record < num_of_records);
     return task_info.error_code;
 }
 
 std::error_code Client::taskWriteFile(const std::uint8_t dev_addr)
 {
-    auto lambda_write_record =
-        [this](const std::uint8_t dev_addr, const std::uint16_t file_id, const std::uint16_t record_id, const std::vector<std::uint8_t>& data)
+    auto lambda_write_records =
+        [this](const std::uint8_t dev_addr, const std::uint16_t file_id, const int first_record, const int num_of_records, const std::uint16_t record_size)
     {
-        request_data = modbus_client.msgWriteFileRecord(dev_addr, file_id, record_id, data);
+        // cached request is sent as it is, with the same length of response expected
+        const CachedFrame cached = frame_cache ? frame_cache->find(first_record, num_of_records) : CachedFrame();
+        if (cached.data == nullptr)
+        {
+            std::array<modbus::FileRecord, modbus::max_file_records> records;
+            for (int i = 0; i < num_of_records; ++i)
+            {
+                records[i].file_id = file_id;
+                records[i].record_id = getRecordId(first_record + i);
+                // record is encoded directly from the file buffer, no intermediate copy
+                records[i].data = file.getRecordData(first_record + i);
+                records[i].length = record_size;
+            }
+            modbus_client.encodeWriteFileRecords(request_data, dev_addr, records.data(), num_of_records);
+        }
         // in case of success we expect message with the same length
-        TaskAttributes attr = TaskAttributes(modbus::FunctionCodes::write_file, request_data.size());
+        TaskAttributes attr = TaskAttributes(modbus::FunctionCodes::write_file, cached.data ? cached.size : request_data.size());
+        attr.record = first_record;
+        attr.num_of_records = num_of_records;
+        attr.frame = cached.data;
         createServerRequest(attr);
     };
 
-    auto lambda_write_file = [this, lambda_write_record](const std::uint8_t dev_addr,const int index, const std::uint16_t record_size)
+    auto lambda_write_file = [this, lambda_write_records](const std::uint8_t dev_addr, const int index, const std::uint16_t record_size,
+                                                          const int first_record, const int last_record, const int records_per_exchange)
     {
-        const std::uint16_t num_of_records = file.getNumOfRecords();
         const std::uint16_t file_id = file.getId();
-        task_info.reset(ClientTasks::file_write, num_of_records, index);
-        for (auto i = 0; i < num_of_records; ++i)
+        // records acknowledged in previous upload attempt or unchanged are
+        // skipped, the rest is sent by runs of adjacent records
+        std::vector<std::pair<int, int>> requests;
+        int i = first_record;
+        while (i < last_record)
         {
-            std::vector<uint8_t> data;
-            data.assign(&(file.getData()[i * record_size]), &(file.getData()[i * record_size]) + record_size);
-            q_exchange.push([this, lambda_write_record, dev_addr, file_id, i, data]
-                            { lambda_write_record(dev_addr, file_id, static_cast<std::uint16_t>(i), data); });
+            int count = 0;
+            while (((i + count) < last_record) && (count < records_per_exchange) && !isRecordSkipped(i + count))
+            {
+                ++count;
+            }
+            if (count != 0)
+            {
+                requests.emplace_back(i, count);
+            }
+            i += std::max(count, 1);
+        }
+        task_info.reset(ClientTasks::file_write, static_cast<int>(requests.size()), index);
+        task_info.window = servers[index].info.transfer_window;
+        for (const auto& request : requests)
+        {
+            const int first = request.first;
+            const int count = request.second;
+            q_exchange.push([lambda_write_records, dev_addr, file_id, first, count, record_size]
+                            { lambda_write_records(dev_addr, file_id, first, count, record_size); });
         }
     };
 
@@ -413,89 +746,476 @@ std::error_code Client::taskWriteFile(const std::uint8_t dev_addr)
         return task_info.error_code;
     }
     auto record_size = servers[index].regs[static_cast<int>(ServerRegisters::record_size)];
-    // we are trying to reach this server through the gateway, perform gateway setup first
-    if (servers[index].info.gateway_addr != 0)
+    const int records_per_exchange = getRecordsPerExchange(modbus::FunctionCodes::write_file, record_size);
+    const int num_of_records = file.getNumOfRecords();
+    frame_cache.reset();
+    if (frame_caching)
     {
-        std::uint16_t expected_length = static_cast<size_t>(modbus_client.getRequriedLength() + record_size + 9);
-        std::uint16_t control_reg = static_cast<std::uint16_t>(ServerRegisters::gateway_buffer_size);
-        auto error = taskWriteRegister(servers[index].info.gateway_addr, control_reg, expected_length);
-        if (error)
+        prepareFrameCache(dev_addr, record_size, records_per_exchange);
+    }
+    // file is written bank by bank, there is the only one for files up to max_num_of_records records
+    int first_record = 0;
+    do
+    {
+        const int last_record = std::min(num_of_records, first_record + modbus::max_num_of_records);
+        int records_to_send = 0;
+        for (int record = first_record; record < last_record; ++record)
         {
-            task_info.error_code = make_error_code(ClientErrors::gateway_not_responding);
-            return task_info.error_code;
+            records_to_send += isRecordSkipped(record) ? 0 : 1;
         }
-        control_reg = static_cast<std::uint16_t>(ServerRegisters::record_counter);
-        error = taskWriteRegister(servers[index].info.gateway_addr, control_reg, file.getNumOfRecords());
-        if (error)
+        if ((records_to_send == 0) && (num_of_records > modbus::max_num_of_records))
+        {
+            // nothing to send in this bank
+            first_record = last_record;
+            continue;
+        }
+        task_info.error_code = taskSetFileBank(dev_addr, first_record);
+        if (task_info.error_code)
         {
-            task_info.error_code = make_error_code(ClientErrors::gateway_not_responding);
             return task_info.error_code;
         }
-
-        control_reg = static_cast<std::uint16_t>(ServerRegisters::gateway_file_control);
-        error = taskWriteRegister(servers[index].info.gateway_addr, control_reg, file_write_prepare);
-        if (error)
+        // we are trying to reach this server through the gateway, perform gateway setup first
+        if (servers[index].info.gateway_addr != 0)
+        {
+            std::uint16_t expected_length = modbus_client.getAduSize(2 + records_per_exchange * (record_size + 7));
+            // gateway control registers are adjacent, they are written in one request
+            const RegisterWrite gateway_setup[] = {
+                {static_cast<std::uint16_t>(ServerRegisters::gateway_buffer_size), expected_length},
+                {static_cast<std::uint16_t>(ServerRegisters::record_counter), static_cast<std::uint16_t>(records_to_send)},
+                {static_cast<std::uint16_t>(ServerRegisters::gateway_file_control), file_write_prepare}};
+            auto error = taskWriteRegisters(servers[index].info.gateway_addr, gateway_setup, std::size(gateway_setup));
+            if (error)
+            {
+                task_info.error_code = make_error_code(ClientErrors::gateway_not_responding);
+                return task_info.error_code;
+            }
+        }
+        task_info.reset();
+        pushTask([dev_addr, lambda_write_file, index, record_size, first_record, last_record, records_per_exchange]()
+                 { lambda_write_file(dev_addr, index, record_size, first_record, last_record, records_per_exchange); });
+        if (waitTaskDone())
         {
-            task_info.error_code = make_error_code(ClientErrors::gateway_not_responding);
             return task_info.error_code;
         }
-    }
-    task_info.reset();
-    q_task.push([this, dev_addr, lambda_write_file, index, record_size]() { lambda_write_file(dev_addr, index, record_size); });
-    while (!task_info.done)
-        ;
+        first_record = last_record;
+    } while (first_record < num_of_records);
     return task_info.error_code;
 }
 
-void Client::clientThread()
+std::error_code Client::taskSetFileBank(const std::uint8_t dev_addr, const int record)
+{
+    if (file.getNumOfRecords() <= modbus::max_num_of_records)
+    {
+        // banks are not used, server may not have the register at all
+        return std::error_code();
+    }
+    return taskWriteRegister(dev_addr, static_cast<std::uint16_t>(ServerRegisters::file_bank), static_cast<std::uint16_t>(getFileBank(record)));
+}
+
+std::error_code Client::taskPrepareUpload(const std::uint8_t dev_addr)
 {
-    using namespace std::chrono_literals;
-    while (!thread_stop.load(std::memory_order_relaxed))
+    // upper half of large image size is written after app_size, which clears it
+    const int num_of_records = file.getNumOfRecords();
+    const RegisterWrite app_size[] = {
+        {static_cast<std::uint16_t>(ServerRegisters::app_size), static_cast<std::uint16_t>(num_of_records & 0xFFFF)},
+        {static_cast<std::uint16_t>(ServerRegisters::app_size_high), static_cast<std::uint16_t>(num_of_records >> 16)}};
+    std::error_code error = taskWriteRegisters(dev_addr, app_size, (num_of_records > modbus::max_num_of_records) ? std::size(app_size) : 1);
+    if (!error)
     {
-        while (!q_task.empty())
+        error = taskWriteRegister(dev_addr, static_cast<std::uint16_t>(ServerRegisters::file_control), file_write_prepare);
+    }
+    return error;
+}
+
+std::error_code Client::taskBroadcastFile(const std::uint16_t record_size)
+{
+    auto lambda_broadcast_records = [this](const int first_record, const int num_of_records, const std::uint16_t record_size)
+    {
+        TaskAttributes attr = TaskAttributes(modbus::FunctionCodes::write_file, 0);
+        const CachedFrame cached = frame_cache ? frame_cache->find(first_record, num_of_records) : CachedFrame();
+        if (cached.data == nullptr)
         {
-            bool error_in_task = false;
-            q_task.front()();
-            while (!q_exchange.empty())
+            std::array<modbus::FileRecord, modbus::max_file_records> records;
+            for (int i = 0; i < num_of_records; ++i)
             {
-                try
-                {
-                    q_exchange.front()();
-                    task.wait();
-                }
-                catch (const std::system_error& e)
-                {
-                    error_in_task = true;
-                    task_info.error_code = e.code();
-                }
-                if (!error_in_task)
-                {
-                    exchangeCallback();
-                }
-                if (task_info.error_code.value())
+                records[i].file_id = file.getId();
+                records[i].record_id = getRecordId(first_record + i);
+                records[i].data = file.getRecordData(first_record + i);
+                records[i].length = record_size;
+            }
+            modbus_client.encodeWriteFileRecords(request_data, modbus::broadcast_address, records.data(), num_of_records);
+        }
+        attr.length = cached.size;
+        attr.frame = cached.data;
+        createServerRequest(attr);
+    };
+    auto lambda_broadcast_bank = [this](const int bank)
+    {
+        modbus_client.encodeWriteRegister(request_data, modbus::broadcast_address, static_cast<std::uint16_t>(ServerRegisters::file_bank),
+                                          static_cast<std::uint16_t>(bank));
+        createServerRequest(TaskAttributes(modbus::FunctionCodes::write_register, 0));
+    };
+
+    const int records_per_exchange = getRecordsPerExchange(modbus::FunctionCodes::write_file, record_size);
+    const int num_of_records = file.getNumOfRecords();
+    frame_cache.reset();
+    if (frame_caching)
+    {
+        prepareFrameCache(modbus::broadcast_address, record_size, records_per_exchange);
+    }
+    // requests never cross bank boundary, so every bank starts a new run
+    std::vector<std::pair<int, int>> requests;
+    for (int i = 0; i < num_of_records;)
+    {
+        int count = 0;
+        while (((i + count) < num_of_records) && (count < records_per_exchange) && file.isRecordPopulated(i + count) &&
+               ((count == 0) || (getFileBank(i + count) == getFileBank(i))))
+        {
+            ++count;
+        }
+        if (count != 0)
+        {
+            requests.emplace_back(i, count);
+        }
+        i += std::max(count, 1);
+    }
+    task_info.reset(ClientTasks::broadcast, static_cast<int>(requests.size()), -1);
+    const bool banked = (num_of_records > modbus::max_num_of_records);
+    pushTask(
+        [this, lambda_broadcast_records, lambda_broadcast_bank, requests, record_size, banked]()
+        {
+            int bank = -1;
+            for (const auto& request : requests)
+            {
+                const int first = request.first;
+                const int count = request.second;
+                if (banked && (getFileBank(first) != bank))
                 {
-                    std::queue<std::function<void()>> empty;
-                    std::swap(q_exchange, empty);
+                    bank = getFileBank(first);
+                    q_exchange.push([lambda_broadcast_bank, bank] { lambda_broadcast_bank(bank); });
                 }
-                else
+                q_exchange.push([lambda_broadcast_records, first, count, record_size] { lambda_broadcast_records(first, count, record_size); });
+            }
+        });
+    return waitTaskDone();
+}
+
+std::error_code Client::taskVerifyRecords(const std::uint8_t dev_addr, const std::vector<int>& records)
+{
+    auto lambda_verify_record = [this](const std::uint8_t dev_addr, const std::uint16_t file_id, const int record)
+    {
+        const std::uint16_t record_length = file.getActualRecordLength(record);
+        modbus_client.encodeReadFileRecord(request_data, dev_addr, file_id, getRecordId(record), record_length / 2);
+        // record data + 1 byte for data length + 1 byte for ref type + 1 byte for resp length + 1 byte for func + modbus required part
+        TaskAttributes attr = TaskAttributes(modbus::FunctionCodes::read_file, modbus_client.getAduSize(record_length + 4));
+        attr.record = record;
+        attr.num_of_records = 1;
+        createServerRequest(attr);
+    };
+
+    task_info.error_code = make_error_code(ClientErrors::server_not_connected);
+    int index = getServerIndex(dev_addr);
+    if (index == -1)
+    {
+        return task_info.error_code;
+    }
+    const std::uint16_t file_id = file.getId();
+    task_info.error_code = std::error_code();
+    // records of one bank are read back in one task
+    size_t first = 0;
+    while (first < records.size())
+    {
+        size_t last = first + 1;
+        while ((last < records.size()) && (getFileBank(records[last]) == getFileBank(records[first])))
+        {
+            ++last;
+        }
+        const std::vector<int> bank_records(records.begin() + first, records.begin() + last);
+        task_info.error_code = taskSetFileBank(dev_addr, records[first]);
+        if (task_info.error_code)
+        {
+            return task_info.error_code;
+        }
+        // we are trying to reach this server through the gateway, perform gateway setup first
+        if (servers[index].info.gateway_addr != 0)
+        {
+            const std::uint16_t record_size = servers[index].regs[static_cast<int>(ServerRegisters::record_size)];
+            const RegisterWrite gateway_setup[] = {
+                {static_cast<std::uint16_t>(ServerRegisters::gateway_buffer_size), static_cast<std::uint16_t>(modbus_client.getAduSize(record_size + 4))},
+                {static_cast<std::uint16_t>(ServerRegisters::record_counter), static_cast<std::uint16_t>(bank_records.size())},
+                {static_cast<std::uint16_t>(ServerRegisters::gateway_file_control), file_read_prepare}};
+            auto error = taskWriteRegisters(servers[index].info.gateway_addr, gateway_setup, std::size(gateway_setup));
+            if (error)
+            {
+                task_info.error_code = make_error_code(ClientErrors::gateway_not_responding);
+                return task_info.error_code;
+            }
+        }
+        task_info.reset(ClientTasks::file_verify, static_cast<int>(bank_records.size()), index);
+        pushTask(
+            [this, lambda_verify_record, dev_addr, file_id, bank_records]()
+            {
+                for (const int record : bank_records)
                 {
-                    q_exchange.pop();
+                    q_exchange.push([lambda_verify_record, dev_addr, file_id, record] { lambda_verify_record(dev_addr, file_id, record); });
                 }
+            });
+        if (waitTaskDone())
+        {
+            return task_info.error_code;
+        }
+        first = last;
+    }
+    return task_info.error_code;
+}
+
+void Client::prepareFrameCache(const std::uint8_t dev_addr, const std::uint16_t record_size, const int records_per_exchange)
+{
+    FrameCacheKey key;
+    key.image_hash = file.getImageHash();
+    key.file_id = file.getId();
+    key.record_size = record_size;
+    key.records_per_exchange = records_per_exchange;
+    key.mode = modbus_client.getMode();
+    key.rtu_padding = modbus_client.getRtuPadding();
+    key.addr = dev_addr;
+    frame_cache = FrameCache::lookup(key, modbus_client);
+    if (frame_cache)
+    {
+        return;
+    }
+    // the same runs as for upload without skipped records
+    const int num_of_records = file.getNumOfRecords();
+    auto cache = std::make_shared<FrameCache>(key, num_of_records);
+    std::array<modbus::FileRecord, modbus::max_file_records> records;
+    modbus::Frame frame;
+    for (int i = 0; i < num_of_records;)
+    {
+        int count = 0;
+        while (((i + count) < num_of_records) && (count < records_per_exchange) && file.isRecordPopulated(i + count) &&
+               ((count == 0) || (getFileBank(i + count) == getFileBank(i))))
+        {
+            records[count].file_id = key.file_id;
+            records[count].record_id = getRecordId(i + count);
+            records[count].data = file.getRecordData(i + count);
+            records[count].length = record_size;
+            ++count;
+        }
+        if (count != 0)
+        {
+            modbus_client.encodeWriteFileRecords(frame, dev_addr, records.data(), count);
+            cache->add(i, count, frame);
+        }
+        i += std::max(count, 1);
+    }
+    FrameCache::store(cache);
+    frame_cache = cache;
+}
+
+void Client::openUploadJournal(const std::uint8_t dev_addr, const std::uint16_t record_size)
+{
+    const int num_of_records = file.getNumOfRecords();
+    const std::uint64_t image_hash = file.getImageHash();
+    if (!journal.open(journal_directory, serial_port.getPath(), dev_addr, image_hash, static_cast<std::uint32_t>(num_of_records), record_size))
+    {
+        std::printf("upload journal is not available, upload can not be resumed \n");
+        return;
+    }
+    const int last_record = journal.getLastAcknowledged();
+    if (last_record == -1)
+    {
+        return;
+    }
+    // server may have been erased or written by someone else since, records
+    // written last and the first one show it
+    std::vector<int> records;
+    for (int record = 0; record <= last_record; ++record)
+    {
+        if (journal.isAcknowledged(record))
+        {
+            records.push_back(record);
+            break;
+        }
+    }
+    for (int record = last_record; (record > records.front()) && (records.size() <= static_cast<size_t>(journal_verify_records)); --record)
+    {
+        if (journal.isAcknowledged(record))
+        {
+            records.push_back(record);
+        }
+    }
+    std::error_code error = taskWriteRegister(dev_addr, static_cast<std::uint16_t>(ServerRegisters::file_control), file_read_prepare);
+    if (!error)
+    {
+        error = taskVerifyRecords(dev_addr, records);
+    }
+    if (error)
+    {
+        std::printf("server does not hold records from the journal: %s, full upload \n", error.message().c_str());
+        journal.reset();
+        return;
+    }
+    std::printf("upload resumed, %d of %d records are already written \n", journal.getNumOfAcknowledged(), num_of_records);
+}
+
+std::error_code Client::findUnchangedRecords(const std::uint8_t dev_addr)
+{
+    const int index = getServerIndex(dev_addr);
+    const size_t record_size = servers[index].regs[static_cast<int>(ServerRegisters::record_size)];
+    // size of the application held by the server, its upper half is read only
+    // if a large image is going to replace it
+    std::error_code error =
+        taskReadRegisters(dev_addr, modbus::holding_regs_offset,
+                          (file.getNumOfRecords() > modbus::max_num_of_records) ? (amount_of_regs + amount_of_ext_regs) : amount_of_regs);
+    if (!error)
+    {
+        // file control write also selects the first file bank
+        error = taskWriteRegister(dev_addr, static_cast<std::uint16_t>(ServerRegisters::file_control), file_read_prepare);
+    }
+    if (error)
+    {
+        return error;
+    }
+    // file control instance is used to read checksums, image is kept aside and
+    // its checksums are calculated while the server sends them
+    File image = std::move(file);
+    auto local_checksums = std::async(std::launch::async,
+                                      [&image, record_size]()
+                                      {
+                                          std::vector<std::uint16_t> checksums(image.getNumOfRecords());
+                                          for (size_t i = 0; i < checksums.size(); ++i)
+                                          {
+                                              const std::uint8_t* record = image.getRecordData(static_cast<int>(i));
+                                              checksums[i] = (record != nullptr) ? modbus::crc16(record, record_size) : 0;
+                                          }
+                                          return checksums;
+                                      });
+    error = taskReadFile(dev_addr, ServerFiles::record_checksums);
+    const std::vector<std::uint16_t> checksums = local_checksums.get();
+    const size_t server_records = getAppSize(servers[index]);
+    if (!error)
+    {
+        unchanged_records.assign(checksums.size(), false);
+        for (size_t i = 0; i < std::min(checksums.size(), server_records); ++i)
+        {
+            const std::uint16_t server_checksum = static_cast<std::uint16_t>((file.getData()[i * 2] << 8) | file.getData()[(i * 2) + 1]);
+            unchanged_records[i] = (server_checksum == checksums[i]);
+        }
+        std::printf("%zu of %zu records are unchanged \n", static_cast<size_t>(std::count(unchanged_records.begin(), unchanged_records.end(), true)),
+                    checksums.size());
+    }
+    file = std::move(image);
+    return error;
+}
+
+bool Client::isRecordSkipped(const int record) const
+{
+    return !file.isRecordPopulated(record) || journal.isAcknowledged(record) || ((static_cast<size_t>(record) < unchanged_records.size()) && unchanged_records[record]);
+}
+
+std::error_code Client::waitTaskDone()
+{
+    std::unique_lock<std::mutex> lock(task_done_mutex);
+    task_done_cv.wait(lock, [this] { return task_info.done.load(); });
+    // gateway state is unknown after failed exchange with it or through it
+    if (task_info.error_code && (task_info.index != -1))
+    {
+        gateway_buffer_sizes.erase(servers[task_info.index].info.addr);
+        gateway_buffer_sizes.erase(servers[task_info.index].info.gateway_addr);
+    }
+    return task_info.error_code;
+}
+
+bool Client::isGatewayBufferSizeSet(const std::uint8_t dev_addr, const std::uint16_t reg_addr, const std::uint16_t value) const
+{
+    if (reg_addr != static_cast<std::uint16_t>(ServerRegisters::gateway_buffer_size))
+    {
+        return false;
+    }
+    auto it = gateway_buffer_sizes.find(dev_addr);
+    return (it != gateway_buffer_sizes.end()) && (it->second == value);
+}
+
+void Client::setTaskDone()
+{
+    {
+        std::lock_guard<std::mutex> lock(task_done_mutex);
+        task_info.done = true;
+    }
+    task_done_cv.notify_one();
+}
+
+void Client::pushTask(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(task_queue_mutex);
+        q_task.push(std::move(task));
+    }
+    task_queue_cv.notify_one();
+}
+
+void Client::clientThread()
+{
+    for (;;)
+    {
+        std::function<void()> actual_task;
+        {
+            // sleep until new task is pushed, q_exchange is used by this thread only
+            std::unique_lock<std::mutex> lock(task_queue_mutex);
+            task_queue_cv.wait(lock, [this] { return thread_stop.load(std::memory_order_relaxed) || !q_task.empty(); });
+            if (thread_stop.load(std::memory_order_relaxed))
+            {
+                return;
             }
+            actual_task = std::move(q_task.front());
             q_task.pop();
         }
-        std::this_thread::sleep_for(50ms);
+        bool error_in_task = false;
+        actual_task();
+        if (task_info.window > 1)
+        {
+            runWindowedExchanges();
+        }
+        while (!q_exchange.empty())
+        {
+            try
+            {
+                q_exchange.front()();
+            }
+            catch (const std::system_error& e)
+            {
+                error_in_task = true;
+                task_info.error_code = e.code();
+            }
+            if (!error_in_task)
+            {
+                exchangeCallback();
+            }
+            if (task_info.error_code.value())
+            {
+                std::queue<std::function<void()>> empty;
+                std::swap(q_exchange, empty);
+            }
+            else
+            {
+                q_exchange.pop();
+            }
+        }
+        // task is finished when all its exchanges are done, including
+        // the ones stopped by error
+        setTaskDone();
     }
 }
 
 void Client::exchangeCallback()
 {
-    auto readRegs = [](ServerData& server, const std::vector<uint8_t>& message)
+    const size_t checksum_size = modbus::getChecksumSize(modbus_client.getMode());
+    auto readRegs = [checksum_size](ServerData& server, const std::vector<uint8_t>& message)
     {
         const int id_length = 2;
         const int id_start = 3;
         int counter = 0;
-        if (message[id_start] > (message.size() - (modbus::crc_size + modbus::address_size + modbus::function_size + 1)))
+        if (message[id_start] > (message.size() - (checksum_size + modbus::address_size + modbus::function_size + 1)))
         {
             return;
         }
@@ -508,11 +1228,19 @@ void Client::exchangeCallback()
         }
     };
     ++task_info.counter;
-    if (modbus_client.isChecksumValid(responce_data))
+    if (task_info.task == ClientTasks::broadcast)
+    {
+        // there is no response to check
+        return;
+    }
+    if (responce_parser.isChecksumValid())
     {
-        std::vector<std::uint8_t> message;
-        modbus_client.extractData(responce_data, message);
-        if (responce_data.size() != task_info.attributes.length)
+        std::vector<std::uint8_t> message(responce_parser.data(), responce_parser.data() + responce_parser.size());
+        if (!isResponseMatching(task_info.attributes))
+        {
+            task_info.error_code = make_error_code(ClientErrors::unexpected_response);
+        }
+        else if (responce_parser.getAduSize() != task_info.attributes.length)
         {
             task_info.error_code = make_error_code(ClientErrors::server_exception);
         }
@@ -534,7 +1262,11 @@ void Client::exchangeCallback()
                     break;
 
                 case ClientTasks::file_write:
-                    std::printf("progress: %d%% \n", getActualTaskProgress());
+                    fileWriteCallback(task_info.attributes);
+                    break;
+
+                case ClientTasks::file_verify:
+                    fileVerifyCallback(task_info.attributes);
                     break;
 
                 default:
@@ -542,15 +1274,10 @@ void Client::exchangeCallback()
                     break;
             }
         }
-
-        if (task_info.counter == task_info.num_of_exchanges)
-        {
-            task_info.done = true;
-        }
     }
     else
     {
-        if (responce_data.size() == 0)
+        if (responce_parser.empty())
         {
             task_info.error_code = make_error_code(ClientErrors::timeout);
         }
@@ -558,7 +1285,114 @@ void Client::exchangeCallback()
         {
             task_info.error_code = make_error_code(ClientErrors::bad_crc);
         }
-        task_info.done = true;
+    }
+}
+
+void Client::runWindowedExchanges()
+{
+    struct Request
+    {
+        std::function<void()> exchange;
+        TaskAttributes attributes;
+        int attempts = 0;
+    };
+    // file record id from write file response, the same as in the request
+    auto getResponseRecord = [this]() -> int
+    {
+        const size_t record_offset = modbus::address_size + modbus::function_size + 4;
+        if (!responce_parser.isChecksumValid() || responce_parser.isException() || (responce_parser.size() < (record_offset + 2)))
+        {
+            return -1;
+        }
+        return (responce_parser.data()[record_offset] << 8) | responce_parser.data()[record_offset + 1];
+    };
+    std::deque<Request> in_flight;
+    std::deque<Request> lost;
+    // request is sent again if it is not the last attempt, task fails otherwise
+    auto retransmit = [this, &lost](Request& request, const ClientErrors reason)
+    {
+        if (request.attempts >= max_transfer_attempts)
+        {
+            task_info.error_code = make_error_code(reason);
+            return;
+        }
+        lost.push_back(std::move(request));
+    };
+
+    try
+    {
+        while (!task_info.error_code && (!q_exchange.empty() || !lost.empty() || !in_flight.empty()))
+        {
+            // keep the window full, lost requests go first
+            while (!task_info.error_code && (in_flight.size() < static_cast<size_t>(task_info.window)) && (!lost.empty() || !q_exchange.empty()))
+            {
+                Request request;
+                if (!lost.empty())
+                {
+                    request = std::move(lost.front());
+                    lost.pop_front();
+                }
+                else
+                {
+                    request.exchange = std::move(q_exchange.front());
+                    q_exchange.pop();
+                }
+                request.exchange();
+                request.attributes = task_info.attributes;
+                ++request.attempts;
+                in_flight.push_back(std::move(request));
+            }
+            if (task_info.error_code)
+            {
+                break;
+            }
+
+            receiveResponse();
+            const int record = getResponseRecord();
+            auto acked = std::find_if(in_flight.begin(), in_flight.end(),
+                                      [this, record](const Request& request)
+                                      {
+                                          return (getRecordId(request.attributes.record) == record) &&
+                                                 (responce_parser.getAduSize() == request.attributes.length) && isResponseMatching(request.attributes);
+                                      });
+            if (acked == in_flight.end())
+            {
+                if (responce_parser.isChecksumValid() && !responce_parser.isException())
+                {
+                    continue; // late response to request already acknowledged
+                }
+                if (responce_parser.isChecksumValid())
+                {
+                    task_info.error_code = make_error_code(ClientErrors::server_exception);
+                    break;
+                }
+                // nothing usable received, responses to all outstanding requests may be lost
+                const ClientErrors reason = responce_parser.empty() ? ClientErrors::timeout : ClientErrors::bad_crc;
+                for (auto& request : in_flight)
+                {
+                    retransmit(request, reason);
+                }
+                in_flight.clear();
+                continue;
+            }
+            // responses come in order, requests sent before the acknowledged one got none
+            for (auto it = in_flight.begin(); it != acked; ++it)
+            {
+                retransmit(*it, ClientErrors::timeout);
+            }
+            ++task_info.counter;
+            fileWriteCallback(acked->attributes);
+            in_flight.erase(in_flight.begin(), acked + 1);
+        }
+    }
+    catch (const std::system_error& e)
+    {
+        task_info.error_code = e.code();
+    }
+    if (task_info.error_code)
+    {
+        std::queue<std::function<void()>> empty;
+        std::swap(q_exchange, empty);
     }
 }
 
@@ -585,7 +1419,36 @@ void Client::fileReadCallback(std::vector<std::uint8_t>& message, const int inde
     }
 }
 
-size_t Client::getFileSize(const ServerFiles file_id)
+void Client::fileWriteCallback(const TaskAttributes& attr)
+{
+    journal.setAcknowledged(attr.record, attr.num_of_records);
+    uploaded_bytes += static_cast<size_t>(attr.num_of_records) * servers[task_info.index].regs[static_cast<int>(ServerRegisters::record_size)];
+    std::printf("progress: %d%% \n", getActualTaskProgress());
+}
+
+void Client::fileVerifyCallback(const TaskAttributes& attr)
+{
+    // record data follows response length, sub-response length and reference type
+    const size_t data_offset = modbus::address_size + modbus::function_size + 3;
+    const size_t record_size = file.getActualRecordLength(attr.record);
+    if ((responce_parser.size() < (data_offset + record_size)) ||
+        (std::memcmp(responce_parser.data() + data_offset, file.getRecordData(attr.record), record_size) != 0))
+    {
+        task_info.error_code = make_error_code(ClientErrors::image_mismatch);
+    }
+}
+
+int Client::getRecordsPerExchange(const modbus::FunctionCodes code, const size_t record_size) const
+{
+    if (!record_packing)
+    {
+        return 1;
+    }
+    const size_t max_records = modbus::ModbusClient::getMaxFileRecords(code, record_size);
+    return (max_records > 1) ? static_cast<int>(max_records) : 1;
+}
+
+size_t Client::getFileSize(const ServerFiles file_id, const ServerData& server)
 {
     size_t file_size = 0;
     switch (file_id)
@@ -593,6 +1456,9 @@ size_t Client::getFileSize(const ServerFiles file_id)
         case ServerFiles::server_metadata:
             file_size = sizeof(BootloaderInfo);
             break;
+        case ServerFiles::record_checksums:
+            file_size = getAppSize(server) * sizeof(std::uint16_t);
+            break;
         case ServerFiles::application:
         default:
             break;
@@ -600,6 +1466,12 @@ size_t Client::getFileSize(const ServerFiles file_id)
     return file_size;
 }
 
+size_t Client::getAppSize(const ServerData& server)
+{
+    return (static_cast<size_t>(server.regs[static_cast<int>(ServerRegisters::app_size_high)]) << 16) |
+           server.regs[static_cast<int>(ServerRegisters::app_size)];
+}
+
 int Client::getServerIndex(const std::uint8_t address)
 {
     auto it = std::find_if(servers.begin(), servers.end(), [address](ServerData& server) { return server.info.addr == address; });
@@ -616,42 +1488,180 @@ int Client::getServerIndex(const std::uint8_t address)
 void Client::createServerRequest(const TaskAttributes& attr)
 {
     task_info.attributes = attr;
-    task = std::async(&Client::callServerExchange, this);
+    // exchanges are already running on client_thread, no need for extra thread
+    if (task_info.task == ClientTasks::broadcast)
+    {
+        // servers process broadcast silently, the next request waits for them
+        sendRequest();
+        bus_idle_time += broadcast_delay;
+    }
+    else if (task_info.window > 1)
+    {
+        // response is received later by runWindowedExchanges
+        sendRequest();
+    }
+    else
+    {
+        callServerExchange();
+    }
 }
 
 void Client::callServerExchange()
 {
-    responce_data.clear();
+    sendRequest();
+    receiveResponse();
+    // late response to previous request is dropped, the actual one may follow it,
+    // no more responses than the window of requests can be late
+    for (int late = 0; (late < max_transfer_window) && responce_parser.isChecksumValid() && !isResponseMatching(task_info.attributes); ++late)
+    {
+        receiveResponse();
+    }
+}
+
+void Client::sendRequest()
+{
+    // keep at least t3.5 of silence on the line between frames
+    std::this_thread::sleep_until(bus_idle_time);
+    // cached requests are sent straight from the frame cache arena
+    const std::uint8_t* data = task_info.attributes.frame ? task_info.attributes.frame : request_data.data();
+    const size_t size = task_info.attributes.frame ? task_info.attributes.length : request_data.size();
+    // address, function, byte count, reference type and file id of file requests
+    std::uint8_t head[modbus::address_size + modbus::function_size + 4] = {};
+    if (modbus_client.decodeMessageHead(data, size, head, sizeof(head)))
+    {
+        task_info.attributes.addr = head[0];
+        task_info.attributes.function = head[modbus::address_size];
+        task_info.attributes.file_id = static_cast<std::uint16_t>((head[4] << 8) | head[5]);
+    }
     try
     {
-        serial_port.port.writeBinary(request_data);
+        serial_port.port.writeBinary(data, size);
     }
     catch (const std::system_error& e)
     {
         task_info.error_code = e.code();
     }
-    std::printf("******************************************\n");
-    std::printf("data sent : size %d \n",request_data.size());
-    for(int i = 0; i < request_data.size(); ++i)
-    {
-        std::printf("0x%x ",request_data[i]);
-    }
-    std::printf("\n\r");
+    // port returns before the frame leaves the line, next frame waits for it
+    bus_idle_time = std::chrono::steady_clock::now() + frame_timing.char_time * static_cast<int>(size) + frame_timing.t35;
+}
+
+void Client::receiveResponse()
+{
+    std::uint8_t chunk[modbus::max_frame_size];
+    responce_parser.reset(modbus_client.getMode(), modbus_client.getRtuPadding());
     try
     {
-        serial_port.port.readBinary(responce_data, task_info.attributes.length);
+        // read only bytes which belong to the expected frame, exchange is finished
+        // as soon as the last byte arrives, including short exception responses
+        size_t bytes_to_read = responce_parser.getBytesToRead();
+        while (bytes_to_read != 0)
+        {
+            size_t bytes_read = serial_port.port.readSome(chunk, std::min(bytes_to_read, sizeof(chunk)));
+            if (bytes_read == 0)
+            {
+                break; // timeout or end of broken frame
+            }
+            const bool frame_started = !responce_parser.empty();
+            responce_parser.push(chunk, bytes_read);
+            // zeros left from the previous frame do not start the character gap timeout
+            if (!frame_started && !responce_parser.empty())
+            {
+                setFrameGapTimeout(true);
+            }
+            bytes_to_read = responce_parser.getBytesToRead();
+        }
+        // receive queue is dropped if the line is out of sync or after timeout, so
+        // response coming late is not taken for the response to the next request,
+        // otherwise early bytes of the next frame are kept in port buffer
+        if ((responce_parser.getStatus() != modbus::ParserStatus::complete) || !responce_parser.isChecksumValid())
+        {
+            serial_port.port.resync();
+        }
     }
     catch (const std::system_error& e)
     {
         task_info.error_code = e.code();
     }
-     std::printf("data received, size : %d \n",responce_data.size());
-    for(int i = 0; i < responce_data.size(); ++i)
+    setFrameGapTimeout(false);
+    bus_idle_time = std::max(bus_idle_time, std::chrono::steady_clock::now() + frame_timing.t35);
+}
+
+bool Client::isResponseMatching(const TaskAttributes& attr) const
+{
+    const std::uint8_t* response = responce_parser.data();
+    const size_t header_size = modbus::address_size + modbus::function_size;
+    if ((responce_parser.size() < header_size) || (response[0] != attr.addr) ||
+        ((response[modbus::address_size] | modbus::exception_flag) != (attr.function | modbus::exception_flag)))
+    {
+        return false;
+    }
+    if (responce_parser.isException() || (attr.record < 0))
+    {
+        return true;
+    }
+    // file sub-responses follow byte count field
+    const size_t end = responce_parser.size() - modbus::getChecksumSize(modbus_client.getMode());
+    size_t offset = header_size + 1;
+    for (int i = 0; i < attr.num_of_records; ++i)
+    {
+        switch (static_cast<modbus::FunctionCodes>(attr.function))
+        {
+            case modbus::FunctionCodes::write_file:
+            {
+                // echo of sub-request: reference type, file id, record id, length and data
+                if ((offset + modbus::file_sub_request_size) > end)
+                {
+                    return false;
+                }
+                const std::uint16_t file_id = static_cast<std::uint16_t>((response[offset + 1] << 8) | response[offset + 2]);
+                const std::uint16_t record_id = static_cast<std::uint16_t>((response[offset + 3] << 8) | response[offset + 4]);
+                const size_t length = static_cast<size_t>((response[offset + 5] << 8) | response[offset + 6]) * 2;
+                if ((response[offset] != modbus::file_reference_type) || (file_id != attr.file_id) || (record_id != getRecordId(attr.record + i)))
+                {
+                    return false;
+                }
+                offset += modbus::file_sub_request_size + length;
+                break;
+            }
+
+            case modbus::FunctionCodes::read_file:
+                // sub-response length, reference type and data, ids are not sent back
+                if (((offset + 2) > end) || (response[offset + 1] != modbus::file_reference_type))
+                {
+                    return false;
+                }
+                offset += 1 + response[offset];
+                break;
+
+            default:
+                return true;
+        }
+    }
+    return offset == end;
+}
+
+void Client::setFrameGapTimeout(const bool enabled)
+{
+#if defined(PLATFORM_LINUX)
+    // only event mode has enough timeout resolution for character gaps,
+    // ASCII frames are delimited by characters and may have gaps up to a second
+    if ((serial_port.port.getIoMode() != sp::PortIoMode::Event) || (frame_timing.t15.count() == 0) ||
+        (modbus_client.getMode() == modbus::ModbusMode::ascii))
+    {
+        return;
+    }
+    // silence longer than t1.5 inside RTU frame means the frame is broken,
+    // the rest of the frame may be delayed by the adapter by line_latency
+    if (enabled)
+    {
+        serial_port.port.setReadTimeout(frame_timing.t15 + line_latency);
+    }
+    else
     {
-        std::printf("0x%x ",responce_data[i]);
+        serial_port.port.setReadTimeout(std::chrono::milliseconds(serial_port.getConfig().timeout_ms));
     }
-    std::printf("\n\r");
-    std::printf("******************************************\n");
-    std::printf("\n\r");
+#else
+    (void)enabled;
+#endif
 }
 } // namespace sm
@@ -0,0 +1,449 @@
+/**
+ * @file sm_crc.cpp
+ *
+ * @brief implementation for functions defined in sm_crc.hpp
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include "../inc/sm_crc.hpp"
+#include <array>
+#include <atomic>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SM_CRC_CLMUL 1
+#define SM_CRC_CLMUL_TARGET __attribute__((target("pclmul,sse2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define SM_CRC_CLMUL 1
+#define SM_CRC_CLMUL_TARGET
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace
+{
+using crc_table = std::array<std::array<std::uint16_t, 256>, 8>;
+using crc_function = std::uint16_t (*)(const std::uint8_t*, size_t, std::uint16_t);
+
+constexpr crc_table makeTables()
+{
+    crc_table tables = {};
+    for (std::uint16_t i = 0; i < 256; ++i)
+    {
+        std::uint16_t crc = i;
+        for (std::uint8_t bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc & 0x01) ? ((crc >> 1) ^ modbus::crc16_poly) : (crc >> 1);
+        }
+        tables[0][i] = crc;
+    }
+    // tables[n] is the crc of the byte followed by n zero bytes
+    for (std::size_t n = 1; n < tables.size(); ++n)
+    {
+        for (std::size_t i = 0; i < 256; ++i)
+        {
+            const std::uint16_t prev = tables[n - 1][i];
+            tables[n][i] = (prev >> 8) ^ tables[0][prev & 0xFF];
+        }
+    }
+    return tables;
+}
+
+constexpr crc_table tables = makeTables();
+
+std::uint16_t crcBitwise(const std::uint8_t* data, size_t length, std::uint16_t crc)
+{
+    const std::uint16_t table[2] = {0x0000, modbus::crc16_poly};
+    for (size_t i = 0; i < length; ++i)
+    {
+        crc ^= data[i];
+        for (std::uint8_t bit = 0; bit < 8; bit++)
+        {
+            std::uint8_t xOr = crc & 0x01;
+            crc >>= 1;
+            crc ^= table[xOr];
+        }
+    }
+    return crc;
+}
+
+std::uint16_t crcTable(const std::uint8_t* data, size_t length, std::uint16_t crc)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        crc = (crc >> 8) ^ tables[0][(crc ^ data[i]) & 0xFF];
+    }
+    return crc;
+}
+
+std::uint16_t crcSlicing8(const std::uint8_t* data, size_t length, std::uint16_t crc)
+{
+    while (length >= 8)
+    {
+        crc = tables[7][(data[0] ^ crc) & 0xFF] ^ tables[6][(data[1] ^ (crc >> 8)) & 0xFF] ^ tables[5][data[2]] ^ tables[4][data[3]] ^
+              tables[3][data[4]] ^ tables[2][data[5]] ^ tables[1][data[6]] ^ tables[0][data[7]];
+        data += 8;
+        length -= 8;
+    }
+    return crcTable(data, length, crc);
+}
+
+/*
+ * crc register is a linear function of the message over GF(2), so running it over zero bytes is
+ * a 16x16 bit matrix applied to the register; matrices for 2^n zero bytes are squares of each
+ * other (the same way zlib combines crc32), any length takes one product per set bit.
+ */
+using gf2_matrix = std::array<std::uint16_t, 16>;
+
+/// matrix column n is the register after the operation for register with bit n set only
+constexpr std::uint16_t gf2Times(const gf2_matrix& matrix, std::uint16_t vector)
+{
+    std::uint16_t sum = 0;
+    for (std::size_t n = 0; vector != 0; ++n, vector >>= 1)
+    {
+        sum ^= (vector & 0x01) ? matrix[n] : 0;
+    }
+    return sum;
+}
+
+constexpr gf2_matrix gf2Square(const gf2_matrix& matrix)
+{
+    gf2_matrix square = {};
+    for (std::size_t n = 0; n < square.size(); ++n)
+    {
+        square[n] = gf2Times(matrix, matrix[n]);
+    }
+    return square;
+}
+
+using shift_table = std::array<gf2_matrix, sizeof(size_t) * 8>;
+
+/// shifts[n] runs crc register over 2^n zero bytes
+constexpr shift_table makeShifts()
+{
+    // one zero bit: register is shifted right, polynomial is added if bit 0 is shifted out
+    gf2_matrix matrix = {};
+    matrix[0] = modbus::crc16_poly;
+    for (std::size_t n = 1; n < matrix.size(); ++n)
+    {
+        matrix[n] = static_cast<std::uint16_t>(1U << (n - 1));
+    }
+    for (int bit = 0; bit < 3; ++bit)
+    {
+        matrix = gf2Square(matrix);
+    }
+    shift_table shifts = {};
+    shifts[0] = matrix;
+    for (std::size_t n = 1; n < shifts.size(); ++n)
+    {
+        shifts[n] = gf2Square(shifts[n - 1]);
+    }
+    return shifts;
+}
+
+constexpr shift_table shifts = makeShifts();
+
+/// shifts[n] for runs up to 64 KiB split by register bytes, one lookup per byte instead of 16 steps
+using byte_shift_table = std::array<std::array<std::array<std::uint16_t, 256>, 2>, 16>;
+
+constexpr byte_shift_table makeByteShifts()
+{
+    byte_shift_table byte_shifts = {};
+    for (std::size_t n = 0; n < byte_shifts.size(); ++n)
+    {
+        for (std::uint16_t i = 0; i < 256; ++i)
+        {
+            byte_shifts[n][0][i] = gf2Times(shifts[n], i);
+            byte_shifts[n][1][i] = gf2Times(shifts[n], static_cast<std::uint16_t>(i << 8));
+        }
+    }
+    return byte_shifts;
+}
+
+constexpr byte_shift_table byte_shifts = makeByteShifts();
+
+#if defined(SM_CRC_CLMUL)
+/*
+ * CRC-16 with polynomial P(x) is equal to the low half of CRC-32 with polynomial P(x) * x^16,
+ * so the usual reflected CRC-32 folding (Intel "Fast CRC Computation Using PCLMULQDQ") is used
+ * with the folding constants generated for 0x80050000.
+ */
+constexpr std::uint64_t clmul_poly = 0x180050000ULL; // P(x) * x^16 with x^32 term
+
+constexpr std::uint64_t reflect(std::uint64_t value, int bits)
+{
+    std::uint64_t result = 0;
+    for (int i = 0; i < bits; ++i)
+    {
+        result = (result << 1) | ((value >> i) & 0x01);
+    }
+    return result;
+}
+
+/// x^n mod P in reflected form shifted left by one, as used by the folding steps
+constexpr std::uint64_t foldConstant(int n)
+{
+    std::uint64_t rem = 1;
+    for (int i = 0; i < n; ++i)
+    {
+        rem <<= 1;
+        if (rem & (1ULL << 32))
+        {
+            rem ^= clmul_poly;
+        }
+    }
+    return reflect(rem, 32) << 1;
+}
+
+/// floor(x^64 / P) in reflected form, Barrett reduction constant
+constexpr std::uint64_t barrettConstant()
+{
+    std::uint64_t rem = 0;
+    std::uint64_t quotient = 0;
+    for (int bit = 64; bit >= 0; --bit)
+    {
+        rem = (rem << 1) | ((bit == 64) ? 1 : 0);
+        if (rem & (1ULL << 32))
+        {
+            rem ^= clmul_poly;
+            quotient |= 1ULL << bit;
+        }
+    }
+    return reflect(quotient, 33);
+}
+
+alignas(16) constexpr std::uint64_t k1k2[2] = {foldConstant(4 * 128 + 32), foldConstant(4 * 128 - 32)};
+alignas(16) constexpr std::uint64_t k3k4[2] = {foldConstant(128 + 32), foldConstant(128 - 32)};
+alignas(16) constexpr std::uint64_t k5k0[2] = {foldConstant(64), 0};
+alignas(16) constexpr std::uint64_t poly_mu[2] = {reflect(clmul_poly, 33), barrettConstant()};
+constexpr size_t clmul_min_length = 64;
+
+/// fold blocks of 16 bytes, length must be at least 64 and a multiple of 16
+SM_CRC_CLMUL_TARGET std::uint16_t clmulFold(const std::uint8_t* data, size_t length, std::uint16_t crc)
+{
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+    data += 64;
+    length -= 64;
+
+    // parallel fold of 64 bytes blocks
+    while (length >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+        y6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+        y7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+        y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        data += 64;
+        length -= 64;
+    }
+
+    // fold 4 lanes into one
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // single fold of 16 bytes blocks
+    while (length >= 16)
+    {
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        data += 16;
+        length -= 16;
+    }
+
+    // fold 128 bits to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits, crc16 is in the low half
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly_mu));
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return static_cast<std::uint16_t>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+}
+
+std::uint16_t crcClmul(const std::uint8_t* data, size_t length, std::uint16_t crc)
+{
+    if (length >= clmul_min_length)
+    {
+        const size_t folded = length & ~static_cast<size_t>(0x0F);
+        crc = clmulFold(data, folded, crc);
+        data += folded;
+        length -= folded;
+    }
+    return crcSlicing8(data, length, crc);
+}
+
+bool isClmulSupported()
+{
+#if defined(_MSC_VER)
+    int info[4] = {};
+    __cpuid(info, 1);
+    return (info[2] & (1 << 1)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse2");
+#endif
+}
+#endif // SM_CRC_CLMUL
+
+crc_function getFunction(const modbus::CrcEngine engine)
+{
+    switch (engine)
+    {
+        case modbus::CrcEngine::bitwise:
+            return crcBitwise;
+
+        case modbus::CrcEngine::table:
+            return crcTable;
+
+        case modbus::CrcEngine::slicing_by_8:
+            return crcSlicing8;
+
+        case modbus::CrcEngine::clmul:
+#if defined(SM_CRC_CLMUL)
+            return crcClmul;
+#else
+            break;
+#endif
+    }
+    return nullptr;
+}
+
+modbus::CrcEngine detectEngine()
+{
+#if defined(SM_CRC_CLMUL)
+    if (isClmulSupported())
+    {
+        return modbus::CrcEngine::clmul;
+    }
+#endif
+    return modbus::CrcEngine::slicing_by_8;
+}
+
+struct ActualEngine
+{
+    std::atomic<modbus::CrcEngine> engine{detectEngine()};
+    std::atomic<crc_function> function{getFunction(engine.load())};
+};
+
+ActualEngine& actualEngine()
+{
+    static ActualEngine obj;
+    return obj;
+}
+} // namespace
+
+namespace modbus
+{
+std::uint16_t crc16(const std::uint8_t* data, const size_t length, const std::uint16_t crc)
+{
+    return actualEngine().function.load(std::memory_order_relaxed)(data, length, crc);
+}
+
+std::uint16_t crc16(const CrcEngine engine, const std::uint8_t* data, const size_t length, const std::uint16_t crc)
+{
+    crc_function function = isCrcEngineSupported(engine) ? getFunction(engine) : crcTable;
+    return function(data, length, crc);
+}
+
+bool isCrcEngineSupported(const CrcEngine engine)
+{
+    switch (engine)
+    {
+        case CrcEngine::bitwise:
+        case CrcEngine::table:
+        case CrcEngine::slicing_by_8:
+            return true;
+
+        case CrcEngine::clmul:
+#if defined(SM_CRC_CLMUL)
+            return isClmulSupported();
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+bool setCrcEngine(const CrcEngine engine)
+{
+    if (!isCrcEngineSupported(engine))
+    {
+        return false;
+    }
+    actualEngine().function.store(getFunction(engine), std::memory_order_relaxed);
+    actualEngine().engine.store(engine, std::memory_order_relaxed);
+    return true;
+}
+
+CrcEngine getCrcEngine() { return actualEngine().engine.load(std::memory_order_relaxed); }
+
+std::uint16_t crc16Shift(std::uint16_t crc, size_t zero_bytes)
+{
+    for (std::size_t n = 0; zero_bytes != 0; ++n, zero_bytes >>= 1)
+    {
+        if (zero_bytes & 0x01)
+        {
+            crc = (n < byte_shifts.size()) ? (byte_shifts[n][0][crc & 0xFF] ^ byte_shifts[n][1][crc >> 8]) : gf2Times(shifts[n], crc);
+        }
+    }
+    return crc;
+}
+
+std::uint16_t crc16Combine(const std::uint16_t crc_a, const std::uint16_t crc_b, const size_t length_b)
+{
+    // crc_b holds the initial value run over length_b bytes, crc_a replaces it
+    return crc16Shift(crc_a ^ crc16_init, length_b) ^ crc_b;
+}
+
+std::uint16_t crc16Patch(const std::uint16_t crc, const size_t length, const size_t position, const std::uint8_t old_value,
+                         const std::uint8_t new_value)
+{
+    if (position >= length)
+    {
+        return crc;
+    }
+    // crc of the difference, leading zero bytes keep zero register
+    return crc ^ crc16Shift(tables[0][old_value ^ new_value], length - position - 1);
+}
+} // namespace modbus
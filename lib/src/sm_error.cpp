@@ -37,6 +37,16 @@ class sm_category_impl : public std::error_category
             case sm::ClientErrors::server_not_connected:
                 return "the server is not connected";
 
+            case sm::ClientErrors::image_mismatch:
+                return "server memory does not match the image";
+
+            case sm::ClientErrors::broadcast_not_supported:
+                return "broadcast needs directly connected servers with the same "
+                       "record size and RTU frames without padding";
+
+            case sm::ClientErrors::unexpected_response:
+                return "response does not match the request";
+
             case sm::ClientErrors::internal:
                 return "internal logic error";
 
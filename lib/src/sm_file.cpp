@@ -8,7 +8,75 @@
  */
 
 #include "../inc/sm_file.hpp"
+#include "../inc/sm_journal.hpp"
+#include <algorithm>
+#include <cctype>
 #include <cstring>
+#include <numeric>
+
+namespace
+{
+/// @brief check if data is filled with 0xFF, 8 bytes per step without early
+/// exit, so the loop is vectorized by compiler
+bool isBlank(const std::uint8_t* data, const size_t length)
+{
+    std::uint64_t word_acc = ~0ULL;
+    size_t i = 0;
+    for (; (i + sizeof(word_acc)) <= length; i += sizeof(word_acc))
+    {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        word_acc &= word;
+    }
+    std::uint8_t byte_acc = 0xFF;
+    for (; i < length; ++i)
+    {
+        byte_acc &= data[i];
+    }
+    return (word_acc == ~0ULL) && (byte_acc == 0xFF);
+}
+
+/// @brief decode hex digits of text line into bytes
+/// @param line text line
+/// @param start position of the first digit
+/// @param bytes vector to save bytes to
+/// @return false if line has odd amount of digits or not a hex digit
+bool parseHexBytes(const std::string& line, const size_t start, std::vector<std::uint8_t>& bytes)
+{
+    auto digit = [](const char c) -> int
+    {
+        if ((c >= '0') && (c <= '9'))
+        {
+            return c - '0';
+        }
+        if ((c >= 'A') && (c <= 'F'))
+        {
+            return c - 'A' + 10;
+        }
+        if ((c >= 'a') && (c <= 'f'))
+        {
+            return c - 'a' + 10;
+        }
+        return -1;
+    };
+    if ((line.size() < start) || (((line.size() - start) % 2) != 0))
+    {
+        return false;
+    }
+    bytes.clear();
+    for (size_t i = start; i < line.size(); i += 2)
+    {
+        const int high = digit(line[i]);
+        const int low = digit(line[i + 1]);
+        if ((high < 0) || (low < 0))
+        {
+            return false;
+        }
+        bytes.push_back(static_cast<std::uint8_t>((high << 4) | low));
+    }
+    return true;
+}
+} // namespace
 
 namespace sm
 {
@@ -30,40 +98,81 @@ size_t File::getFileSize(const std::string path_to_file) const
 void File::fileDelete()
 {
     data.reset();
+    image.reset();
+    segments.clear();
+    base_address = 0;
     num_of_records = 0;
     record_size = 0;
     counter = 0;
     file_size = 0;
     ready = false;
+    image_hash_ready = false;
 }
 
 bool File::fileReadSetup(const std::uint16_t id, const size_t file_size, const std::uint8_t record_size)
 {
-    if (data)
+    fileDelete();
+    this->id = id;
+    this->record_size = record_size;
+    num_of_records = calcNumOfRecords(file_size);
+    // buffer holds whole records, the last one may be partially used by the file
+    this->file_size = (num_of_records > 0) ? (static_cast<size_t>(num_of_records) * record_size) : record_size;
+    data = std::make_unique<std::uint8_t[]>(this->file_size);
+    segments.push_back({0, num_of_records, data.get()});
+    return data != nullptr;
+}
+
+bool File::fileExternalWriteSetup(const std::uint16_t id, const std::string path_to_file, const std::uint8_t record_size)
+{
+    fileDelete();
+    this->record_size = record_size;
+    std::string extension = path_to_file.substr(std::min(path_to_file.find_last_of('.'), path_to_file.size()));
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    std::vector<Chunk> chunks;
+    bool result = false;
+    if ((extension == ".hex") || (extension == ".ihex"))
     {
-        fileDelete();
+        result = readIntelHex(path_to_file, chunks) && mapChunks(chunks);
     }
-    if(file_size < record_size)
+    else if ((extension == ".srec") || (extension == ".s19") || (extension == ".s28") || (extension == ".s37") || (extension == ".mot"))
     {
-        data = std::make_unique<std::uint8_t[]>(record_size);
-        this->file_size = record_size;
+        result = readSrecord(path_to_file, chunks) && mapChunks(chunks);
     }
     else
     {
-        data = std::make_unique<std::uint8_t[]>(file_size);
-        this->file_size = file_size;
+        result = loadBinary(path_to_file);
+    }
+    if (!result)
+    {
+        fileDelete();
+        return false;
     }
     this->id = id;
-    this->record_size = record_size;
-    num_of_records = calcNumOfRecords(file_size);
-    return data != nullptr;
+    return true;
 }
 
-bool File::fileExternalWriteSetup(const std::uint16_t id, const std::string path_to_file, const std::uint8_t record_size)
+bool File::loadBinary(const std::string& path_to_file)
 {
-    if (data)
+    image = MappedImage::open(path_to_file);
+    if (image)
     {
-        fileDelete();
+        file_size = image->getSize();
+        num_of_records = calcNumOfRecords(file_size);
+        const int full_records = (record_size > 0) ? static_cast<int>(std::min<size_t>(file_size / record_size, static_cast<size_t>(num_of_records))) : 0;
+        if (full_records > 0)
+        {
+            segments.push_back({0, full_records, image->getData()});
+        }
+        if (full_records < num_of_records)
+        {
+            // partial last record is padded as erased flash, it can't be read from the mapping
+            const size_t used = file_size - (static_cast<size_t>(full_records) * record_size);
+            data = std::make_unique<std::uint8_t[]>(record_size);
+            std::fill(data.get(), data.get() + record_size, 0xFF);
+            std::copy(image->getData() + (file_size - used), image->getData() + file_size, data.get());
+            segments.push_back({full_records, 1, data.get()});
+        }
+        return true;
     }
     size_t length = getFileSize(path_to_file);
     if (length > 0)
@@ -71,7 +180,10 @@ bool File::fileExternalWriteSetup(const std::uint16_t id, const std::string path
         std::ifstream tmp(path_to_file, std::ifstream::binary);
         if (tmp)
         {
-            data = std::make_unique<std::uint8_t[]>(length);
+            // buffer holds whole records, the last one is padded as erased flash
+            const size_t buffer_size = (record_size > 0) ? (((length + record_size - 1) / record_size) * record_size) : length;
+            data = std::make_unique<std::uint8_t[]>(buffer_size);
+            std::fill(data.get() + length, data.get() + buffer_size, 0xFF);
             // load all file to RAM buffer at one time
             tmp.read(reinterpret_cast<char*>(data.get()), length);
             if (tmp)
@@ -86,9 +198,8 @@ bool File::fileExternalWriteSetup(const std::uint16_t id, const std::string path
         }
         if (file_size == length)
         {
-            this->id = id;
-            this->record_size = record_size;
             num_of_records = calcNumOfRecords(file_size);
+            segments.push_back({0, num_of_records, data.get()});
             return true;
         }
         else
@@ -102,39 +213,331 @@ bool File::fileExternalWriteSetup(const std::uint16_t id, const std::string path
     }
 }
 
-bool File::getRecordFromMessage(const std::vector<std::uint8_t>& message)
+bool File::readIntelHex(const std::string& path_to_file, std::vector<Chunk>& chunks)
 {
-    const std::uint8_t data_idx = 5;
-    const std::uint8_t data_size = message[2] - 1;
-    const int record_idx = counter * record_size;
+    std::ifstream input(path_to_file);
+    std::string line;
+    std::vector<std::uint8_t> bytes;
+    std::uint32_t extended_address = 0;
+    bool end_of_file = false;
+    while (!end_of_file && std::getline(input, line))
+    {
+        if (!line.empty() && (line.back() == '\r'))
+        {
+            line.pop_back();
+        }
+        if (line.empty())
+        {
+            continue;
+        }
+        // ':', byte count, address, type, data, checksum
+        const size_t min_bytes = 5;
+        if ((line[0] != ':') || !parseHexBytes(line, 1, bytes) || (bytes.size() < min_bytes) || (bytes.size() != (bytes[0] + min_bytes)) ||
+            ((std::accumulate(bytes.begin(), bytes.end(), 0U) & 0xFFU) != 0))
+        {
+            return false;
+        }
+        const std::uint8_t* record_data = bytes.data() + 4;
+        const size_t length = bytes[0];
+        switch (bytes[3])
+        {
+            case intel_hex_data:
+                addChunk(chunks, extended_address + ((bytes[1] << 8) | bytes[2]), record_data, length);
+                break;
+
+            case intel_hex_end_of_file:
+                if (length != 0)
+                {
+                    return false;
+                }
+                end_of_file = true;
+                break;
+
+            case intel_hex_extended_segment_address:
+                if (length != intel_hex_address_length)
+                {
+                    return false;
+                }
+                extended_address = static_cast<std::uint32_t>((record_data[0] << 8) | record_data[1]) << 4;
+                break;
 
-    if (static_cast<size_t>(record_idx + data_size) <= file_size)
+            case intel_hex_extended_linear_address:
+                if (length != intel_hex_address_length)
+                {
+                    return false;
+                }
+                extended_address = static_cast<std::uint32_t>((record_data[0] << 8) | record_data[1]) << 16;
+                break;
+
+            case intel_hex_start_segment_address:
+            case intel_hex_start_linear_address:
+                // start address is not needed for upload, the record is checked only
+                if (length != intel_hex_start_address_length)
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+        }
+    }
+    return end_of_file && !chunks.empty();
+}
+
+bool File::readSrecord(const std::string& path_to_file, std::vector<Chunk>& chunks)
+{
+    std::ifstream input(path_to_file);
+    std::string line;
+    std::vector<std::uint8_t> bytes;
+    while (std::getline(input, line))
     {
+        if (!line.empty() && (line.back() == '\r'))
+        {
+            line.pop_back();
+        }
+        if (line.empty())
+        {
+            continue;
+        }
+        // 'S', type, byte count, address, data, checksum
+        if ((line.size() < 4) || (line[0] != 'S') || !parseHexBytes(line, 2, bytes) || (bytes.size() != (bytes[0] + 1U)) ||
+            ((std::accumulate(bytes.begin(), bytes.end(), 0U) & 0xFFU) != 0xFFU))
+        {
+            return false;
+        }
+        size_t address_size = 0;
+        bool data_record = false;
+        switch (line[1])
+        {
+            case '1':
+                address_size = 2;
+                data_record = true;
+                break;
+            case '2':
+                address_size = 3;
+                data_record = true;
+                break;
+            case '3':
+                address_size = 4;
+                data_record = true;
+                break;
+            case '0':
+            case '5':
+            case '9':
+                address_size = 2;
+                break;
+            case '6':
+            case '8':
+                address_size = 3;
+                break;
+            case '7':
+                address_size = 4;
+                break;
+            default:
+                return false;
+        }
+        // byte count, address and checksum
+        if (bytes.size() < (address_size + 2))
+        {
+            return false;
+        }
+        if (!data_record)
+        {
+            // header, record count and start address records are not needed for upload,
+            // only the header may carry data after the address
+            if ((line[1] != '0') && (bytes.size() != (address_size + 2)))
+            {
+                return false;
+            }
+            continue;
+        }
+        std::uint32_t address = 0;
+        for (size_t i = 0; i < address_size; ++i)
+        {
+            address = (address << 8) | bytes[1 + i];
+        }
+        addChunk(chunks, address, bytes.data() + 1 + address_size, bytes.size() - address_size - 2);
+    }
+    return !chunks.empty();
+}
+
+bool File::mapChunks(std::vector<Chunk>& chunks)
+{
+    if ((record_size == 0) || chunks.empty())
+    {
+        return false;
+    }
+    // chunks are never empty, addChunk does not add them
+    std::sort(chunks.begin(), chunks.end(), [](const Chunk& a, const Chunk& b) { return a.address < b.address; });
+    base_address = chunks.front().address - (chunks.front().address % record_size);
+    // records touched by chunks, chunks which share a record or lie in adjacent records form one segment
+    for (const Chunk& chunk : chunks)
+    {
+        const int first = static_cast<int>((chunk.address - base_address) / record_size);
+        const int last = static_cast<int>((chunk.address + chunk.data.size() - 1 - base_address) / record_size);
+        if (!segments.empty() && (first <= (segments.back().first_record + segments.back().num_of_records)))
+        {
+            segments.back().num_of_records = std::max(segments.back().num_of_records, last - segments.back().first_record + 1);
+        }
+        else
+        {
+            segments.push_back({first, last - first + 1, nullptr});
+        }
+    }
+    if (segments.empty())
+    {
+        return false;
+    }
+    const int total_records = segments.back().first_record + segments.back().num_of_records;
+    if (total_records > max_image_records)
+    {
+        return false;
+    }
+    num_of_records = total_records;
+    file_size = 0;
+    for (const Segment& segment : segments)
+    {
+        file_size += static_cast<size_t>(segment.num_of_records) * record_size;
+    }
+    data = std::make_unique<std::uint8_t[]>(file_size);
+    std::fill(data.get(), data.get() + file_size, 0xFF);
+    // segments are stored one after another in the buffer
+    size_t offset = 0;
+    for (Segment& segment : segments)
+    {
+        segment.records = data.get() + offset;
+        offset += static_cast<size_t>(segment.num_of_records) * record_size;
+    }
+    for (const Chunk& chunk : chunks)
+    {
+        for (size_t i = 0; i < chunk.data.size();)
+        {
+            const size_t position = chunk.address + i - base_address;
+            const int record = static_cast<int>(position / record_size);
+            const size_t length = std::min(chunk.data.size() - i, record_size - (position % record_size));
+            const size_t offset = static_cast<size_t>(getRecordData(record) - data.get()) + (position % record_size);
+            std::copy(chunk.data.begin() + i, chunk.data.begin() + i + length, data.get() + offset);
+            i += length;
+        }
+    }
+    return true;
+}
+
+const std::uint8_t* File::getRecordData(const int index) const
+{
+    auto it = std::upper_bound(segments.begin(), segments.end(), index, [](const int record, const Segment& segment) { return record < segment.first_record; });
+    if (it == segments.begin())
+    {
+        return nullptr;
+    }
+    --it;
+    if (index >= (it->first_record + it->num_of_records))
+    {
+        return nullptr;
+    }
+    return it->records + static_cast<size_t>(index - it->first_record) * record_size;
+}
+
+bool File::getRecordFromMessage(const std::vector<std::uint8_t>& message)
+{
+    // address, function code, response data length, then sub-responses:
+    // length (includes reference type byte), reference type, record data
+    const size_t header_size = 3;
+    if (message.size() < header_size)
+    {
+        return false;
+    }
+    const size_t end = header_size + message[2];
+    if (end > message.size())
+    {
+        return false;
+    }
+    size_t offset = header_size;
+    while (offset < end)
+    {
+        const size_t data_size = message[offset] - 1;
+        const size_t data_idx = offset + 2;
+        const size_t record_idx = static_cast<size_t>(counter) * record_size;
+        if ((message[offset] == 0) || ((data_idx + data_size) > end) || ((record_idx + data_size) > file_size))
+        {
+            return false;
+        }
         std::copy(message.data() + data_idx, message.data() + data_idx + data_size, data.get() + record_idx);
         ++counter;
         if (counter == num_of_records)
         {
             ready = true;
         }
-        return true;
+        offset = data_idx + data_size;
+    }
+    return true;
+}
+
+void File::addChunk(std::vector<Chunk>& chunks, const std::uint32_t address, const std::uint8_t* bytes, const size_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+    // lines usually follow each other, they are collected into one chunk then
+    if (!chunks.empty() && ((chunks.back().address + chunks.back().data.size()) == address))
+    {
+        chunks.back().data.insert(chunks.back().data.end(), bytes, bytes + length);
     }
     else
     {
-        return false;
+        chunks.push_back({address, std::vector<std::uint8_t>(bytes, bytes + length)});
     }
 }
 
-std::uint16_t File::calcNumOfRecords(const size_t file_size) const
+std::vector<bool> File::getBlankRecords() const
 {
-    std::uint16_t num_of_records = 0;
-    if ((record_size > 0) && (file_size > 0))
+    std::vector<bool> blank(num_of_records, false);
+    for (size_t i = 0; i < blank.size(); ++i)
+    {
+        const std::uint8_t* record = getRecordData(static_cast<int>(i));
+        blank[i] = (record != nullptr) && isBlank(record, record_size);
+    }
+    return blank;
+}
+
+std::uint64_t File::getImageHash() const
+{
+    if (!image_hash_ready)
+    {
+        image_hash = image ? image->getHash(record_size, [this] { return calcImageHash(); }) : calcImageHash();
+        image_hash_ready = true;
+    }
+    return image_hash;
+}
+
+std::uint64_t File::calcImageHash() const
+{
+    // gaps between sections are a part of the image as well
+    std::uint64_t hash = journal_hash_init;
+    for (int record = 0; record < num_of_records; ++record)
     {
-        num_of_records = (file_size % record_size) ? ((file_size / record_size) + 1) : (file_size / record_size);
-        if (num_of_records > modbus::max_num_of_records)
+        const std::uint8_t* record_data = getRecordData(record);
+        if (record_data != nullptr)
         {
-            num_of_records = 0;
+            const std::uint8_t record_id[] = {static_cast<std::uint8_t>(record >> 24), static_cast<std::uint8_t>(record >> 16),
+                                              static_cast<std::uint8_t>(record >> 8), static_cast<std::uint8_t>(record & 0xFF)};
+            hash = Journal::hashImage(record_id, sizeof(record_id), hash);
+            hash = Journal::hashImage(record_data, record_size, hash);
         }
     }
+    return hash;
+}
+
+int File::calcNumOfRecords(const size_t file_size) const
+{
+    int num_of_records = 0;
+    if ((record_size > 0) && (file_size > 0))
+    {
+        const size_t records = (file_size + record_size - 1) / record_size;
+        num_of_records = (records > static_cast<size_t>(max_image_records)) ? 0 : static_cast<int>(records);
+    }
     return num_of_records;
 }
 
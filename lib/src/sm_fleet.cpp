@@ -0,0 +1,134 @@
+/**
+ * @file sm_fleet.cpp
+ *
+ * @brief implementation for class defined in sm_fleet.hpp
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include "../inc/sm_fleet.hpp"
+#include "../inc/sm_image.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+namespace sm
+{
+bool Fleet::loadManifest(const std::string& path_to_file, std::vector<FleetJob>& jobs)
+{
+    std::ifstream input(path_to_file);
+    if (!input)
+    {
+        return false;
+    }
+    std::string line;
+    while (std::getline(input, line))
+    {
+        std::istringstream fields(line);
+        FleetJob job;
+        unsigned int address = 0;
+        unsigned int gateway = 0;
+        if (!(fields >> job.port) || (job.port[0] == '#'))
+        {
+            continue;
+        }
+        if (!(fields >> address >> gateway >> job.image) || (address == 0) || (address > 247) || (gateway > 247) || (gateway == address))
+        {
+            return false;
+        }
+        job.address = static_cast<std::uint8_t>(address);
+        job.gateway = static_cast<std::uint8_t>(gateway);
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+std::vector<FleetResult> Fleet::run(const std::vector<FleetJob>& jobs, const size_t workers) const
+{
+    std::vector<FleetResult> results(jobs.size());
+    // binary images are mapped once here, sessions get the same mappings
+    // from the registry instead of loading their own copies
+    std::vector<std::shared_ptr<const MappedImage>> images;
+    std::vector<std::vector<size_t>> sessions;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        images.push_back(MappedImage::open(jobs[i].image));
+        results[i].job = jobs[i];
+        auto it = std::find_if(sessions.begin(), sessions.end(), [&jobs, i](const std::vector<size_t>& session) { return jobs[session.front()].port == jobs[i].port; });
+        if (it != sessions.end())
+        {
+            it->push_back(i);
+        }
+        else
+        {
+            sessions.push_back({i});
+        }
+    }
+    // sessions wait for the line almost all the time, so there is a thread per
+    // session by default, the limit is for hosts with too many adapters; the
+    // Client of each running session has its own client_thread on top of it
+    const size_t threads = (workers == 0) ? sessions.size() : std::min(workers, sessions.size());
+    std::atomic<size_t> next_session{0};
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < threads; ++i)
+    {
+        pool.emplace_back(
+            [this, &jobs, &sessions, &results, &next_session]()
+            {
+                for (size_t session = next_session++; session < sessions.size(); session = next_session++)
+                {
+                    runSession(jobs, sessions[session], results);
+                }
+            });
+    }
+    for (std::thread& thread : pool)
+    {
+        thread.join();
+    }
+    return results;
+}
+
+void Fleet::runSession(const std::vector<FleetJob>& jobs, const std::vector<size_t>& session, std::vector<FleetResult>& results) const
+{
+    Client client;
+    // boards of the fleet mostly share images, requests are encoded once per process
+    client.setFrameCache(true);
+    for (const size_t i : session)
+    {
+        if (jobs[i].gateway != 0)
+        {
+            client.addServer(jobs[i].gateway);
+        }
+        client.addServer(jobs[i].address, jobs[i].gateway);
+    }
+    std::error_code error = client.start(jobs[session.front()].port);
+    if (!error)
+    {
+        error = client.configure(config);
+    }
+    for (const size_t i : session)
+    {
+        const auto start_time = std::chrono::steady_clock::now();
+        results[i].error = error;
+        if (!results[i].error && (jobs[i].gateway != 0))
+        {
+            results[i].error = client.connect(jobs[i].gateway);
+        }
+        if (!results[i].error)
+        {
+            results[i].error = client.connect(jobs[i].address);
+        }
+        if (!results[i].error)
+        {
+            results[i].error = client.uploadApp(jobs[i].address, jobs[i].image);
+            results[i].uploaded_bytes = client.getUploadedBytes();
+        }
+        results[i].elapsed = std::chrono::steady_clock::now() - start_time;
+    }
+    client.stop();
+}
+} // namespace sm
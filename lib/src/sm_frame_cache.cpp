@@ -0,0 +1,101 @@
+/**
+ * @file sm_frame_cache.cpp
+ *
+ * @brief implementation for class defined in sm_frame_cache.hpp
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include "../inc/sm_frame_cache.hpp"
+#include <algorithm>
+#include <list>
+#include <mutex>
+
+namespace
+{
+/// @brief frames cached by all clients of the process, the most recently used first
+std::mutex registry_mutex;
+std::list<std::shared_ptr<const sm::FrameCache>> registry;
+} // namespace
+
+namespace sm
+{
+FrameCache::FrameCache(const FrameCacheKey& key, const int num_of_records)
+    : key(key), first_record_entries(static_cast<size_t>(std::max(num_of_records, 0)), -1)
+{
+}
+
+void FrameCache::add(const int first_record, const int num_of_records, const modbus::Frame& frame)
+{
+    if ((first_record < 0) || (static_cast<size_t>(first_record) >= first_record_entries.size()) || frame.empty())
+    {
+        return;
+    }
+    Entry entry;
+    entry.offset = arena.size();
+    entry.size = static_cast<std::uint16_t>(frame.size());
+    entry.num_of_records = static_cast<std::uint16_t>(num_of_records);
+    arena.insert(arena.end(), frame.begin(), frame.end());
+    first_record_entries[first_record] = static_cast<int>(entries.size());
+    entries.push_back(entry);
+}
+
+CachedFrame FrameCache::find(const int first_record, const int num_of_records) const
+{
+    if ((first_record < 0) || (static_cast<size_t>(first_record) >= first_record_entries.size()) || (first_record_entries[first_record] == -1))
+    {
+        return CachedFrame();
+    }
+    const Entry& entry = entries[first_record_entries[first_record]];
+    if (entry.num_of_records != num_of_records)
+    {
+        return CachedFrame();
+    }
+    return CachedFrame{arena.data() + entry.offset, entry.size};
+}
+
+std::shared_ptr<const FrameCache> FrameCache::lookup(const FrameCacheKey& key, const modbus::ModbusClient& encoder)
+{
+    std::shared_ptr<const FrameCache> source;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto it = registry.begin(); it != registry.end(); ++it)
+        {
+            if ((*it)->getKey() == key)
+            {
+                registry.splice(registry.begin(), registry, it);
+                return registry.front();
+            }
+            if (!source && (*it)->getKey().isSameLayout(key))
+            {
+                source = *it;
+            }
+        }
+    }
+    if (!source)
+    {
+        return nullptr;
+    }
+    // the same requests to another server, only address and crc are changed
+    auto cache = std::make_shared<FrameCache>(*source);
+    cache->key.addr = key.addr;
+    for (const Entry& entry : cache->entries)
+    {
+        encoder.restampAddress(cache->arena.data() + entry.offset, entry.size, key.addr);
+    }
+    store(cache);
+    return cache;
+}
+
+void FrameCache::store(const std::shared_ptr<const FrameCache>& cache)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.remove_if([&cache](const std::shared_ptr<const FrameCache>& entry) { return entry->getKey() == cache->getKey(); });
+    registry.push_front(cache);
+    if (registry.size() > frame_cache_capacity)
+    {
+        registry.pop_back();
+    }
+}
+} // namespace sm
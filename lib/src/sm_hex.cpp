@@ -0,0 +1,358 @@
+/**
+ * @file sm_hex.cpp
+ *
+ * @brief implementation for functions defined in sm_hex.hpp
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include "../inc/sm_hex.hpp"
+#include <array>
+#include <atomic>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SM_HEX_SIMD 1
+#define SM_HEX_SSE2_TARGET __attribute__((target("sse2")))
+#define SM_HEX_AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define SM_HEX_SIMD 1
+#define SM_HEX_SSE2_TARGET
+#define SM_HEX_AVX2_TARGET
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace
+{
+using encode_function = void (*)(const std::uint8_t*, size_t, std::uint8_t*);
+using decode_function = bool (*)(const std::uint8_t*, size_t, std::uint8_t*);
+
+constexpr std::uint8_t invalid_nibble = 0xFF;
+
+constexpr std::array<std::uint8_t, 16> makeDigits()
+{
+    std::array<std::uint8_t, 16> digits = {};
+    for (std::uint8_t i = 0; i < digits.size(); ++i)
+    {
+        digits[i] = static_cast<std::uint8_t>((i < 10) ? ('0' + i) : ('A' + i - 10));
+    }
+    return digits;
+}
+
+constexpr std::array<std::uint8_t, 256> makeNibbles()
+{
+    std::array<std::uint8_t, 256> nibbles = {};
+    for (std::size_t i = 0; i < nibbles.size(); ++i)
+    {
+        nibbles[i] = invalid_nibble;
+    }
+    for (std::uint8_t i = 0; i < 10; ++i)
+    {
+        nibbles['0' + i] = i;
+    }
+    for (std::uint8_t i = 0; i < 6; ++i)
+    {
+        nibbles['A' + i] = static_cast<std::uint8_t>(10 + i);
+        nibbles['a' + i] = static_cast<std::uint8_t>(10 + i);
+    }
+    return nibbles;
+}
+
+constexpr std::array<std::uint8_t, 16> digits = makeDigits();
+constexpr std::array<std::uint8_t, 256> nibbles = makeNibbles();
+
+void encodeScalar(const std::uint8_t* data, size_t length, std::uint8_t* hex)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        hex[2 * i] = digits[data[i] >> 4];
+        hex[2 * i + 1] = digits[data[i] & 0x0F];
+    }
+}
+
+bool decodeScalar(const std::uint8_t* hex, size_t length, std::uint8_t* data)
+{
+    // invalid nibble has high bits set, checked once for the whole run
+    std::uint8_t invalid = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        const std::uint8_t high = nibbles[hex[2 * i]];
+        const std::uint8_t low = nibbles[hex[2 * i + 1]];
+        invalid |= high | low;
+        data[i] = static_cast<std::uint8_t>((high << 4) | (low & 0x0F));
+    }
+    return (invalid & 0xF0) == 0;
+}
+
+#if defined(SM_HEX_SIMD)
+/*
+ * Nibbles are converted to digits by adding '0' and 7 more for nibbles above 9. Characters are
+ * decoded with signed compares, which is fine as every character above 0x7F is out of both
+ * ranges; lower case letters are folded by setting bit 5, digits have it set already.
+ */
+SM_HEX_SSE2_TARGET __m128i toDigits(const __m128i nibble)
+{
+    const __m128i letter = _mm_cmpgt_epi8(nibble, _mm_set1_epi8(9));
+    return _mm_add_epi8(_mm_add_epi8(nibble, _mm_set1_epi8('0')), _mm_and_si128(letter, _mm_set1_epi8(7)));
+}
+
+SM_HEX_SSE2_TARGET __m128i toNibbles(const __m128i hex, __m128i& valid)
+{
+    const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(hex, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(hex, _mm_set1_epi8('9' + 1)));
+    const __m128i folded = _mm_or_si128(hex, _mm_set1_epi8(0x20));
+    const __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(folded, _mm_set1_epi8('f' + 1)));
+    valid = _mm_and_si128(valid, _mm_or_si128(digit, letter));
+    return _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(hex, _mm_set1_epi8('0'))),
+                        _mm_and_si128(letter, _mm_sub_epi8(folded, _mm_set1_epi8('a' - 10))));
+}
+
+/// high nibble is in the low byte of every half word, result is in the low byte
+SM_HEX_SSE2_TARGET __m128i joinNibbles(const __m128i pairs)
+{
+    return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(pairs, _mm_set1_epi16(0x00FF)), 4), _mm_srli_epi16(pairs, 8));
+}
+
+SM_HEX_SSE2_TARGET void encodeSse2(const std::uint8_t* data, size_t length, std::uint8_t* hex)
+{
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    while (length >= 16)
+    {
+        const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        const __m128i high = _mm_and_si128(_mm_srli_epi16(value, 4), mask);
+        const __m128i low = _mm_and_si128(value, mask);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(hex), toDigits(_mm_unpacklo_epi8(high, low)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(hex + 16), toDigits(_mm_unpackhi_epi8(high, low)));
+        data += 16;
+        hex += 32;
+        length -= 16;
+    }
+    encodeScalar(data, length, hex);
+}
+
+SM_HEX_SSE2_TARGET bool decodeSse2(const std::uint8_t* hex, size_t length, std::uint8_t* data)
+{
+    __m128i valid = _mm_set1_epi8(-1);
+    while (length >= 16)
+    {
+        const __m128i first = toNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex)), valid);
+        const __m128i second = toNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + 16)), valid);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data), _mm_packus_epi16(joinNibbles(first), joinNibbles(second)));
+        hex += 32;
+        data += 16;
+        length -= 16;
+    }
+    return (_mm_movemask_epi8(valid) == 0xFFFF) && decodeScalar(hex, length, data);
+}
+
+SM_HEX_AVX2_TARGET __m256i toDigits(const __m256i nibble)
+{
+    const __m256i letter = _mm256_cmpgt_epi8(nibble, _mm256_set1_epi8(9));
+    return _mm256_add_epi8(_mm256_add_epi8(nibble, _mm256_set1_epi8('0')), _mm256_and_si256(letter, _mm256_set1_epi8(7)));
+}
+
+SM_HEX_AVX2_TARGET __m256i toNibbles(const __m256i hex, __m256i& valid)
+{
+    const __m256i digit = _mm256_andnot_si256(_mm256_cmpgt_epi8(hex, _mm256_set1_epi8('9')), _mm256_cmpgt_epi8(hex, _mm256_set1_epi8('0' - 1)));
+    const __m256i folded = _mm256_or_si256(hex, _mm256_set1_epi8(0x20));
+    const __m256i letter =
+        _mm256_andnot_si256(_mm256_cmpgt_epi8(folded, _mm256_set1_epi8('f')), _mm256_cmpgt_epi8(folded, _mm256_set1_epi8('a' - 1)));
+    valid = _mm256_and_si256(valid, _mm256_or_si256(digit, letter));
+    return _mm256_or_si256(_mm256_and_si256(digit, _mm256_sub_epi8(hex, _mm256_set1_epi8('0'))),
+                           _mm256_and_si256(letter, _mm256_sub_epi8(folded, _mm256_set1_epi8('a' - 10))));
+}
+
+SM_HEX_AVX2_TARGET __m256i joinNibbles(const __m256i pairs)
+{
+    return _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(pairs, _mm256_set1_epi16(0x00FF)), 4), _mm256_srli_epi16(pairs, 8));
+}
+
+/// unpack and pack work inside 128-bit lanes, lanes are put back in order by permutes
+SM_HEX_AVX2_TARGET void encodeAvx2(const std::uint8_t* data, size_t length, std::uint8_t* hex)
+{
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    while (length >= 32)
+    {
+        const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        const __m256i high = _mm256_and_si256(_mm256_srli_epi16(value, 4), mask);
+        const __m256i low = _mm256_and_si256(value, mask);
+        const __m256i first = toDigits(_mm256_unpacklo_epi8(high, low));
+        const __m256i second = toDigits(_mm256_unpackhi_epi8(high, low));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(hex), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(hex + 32), _mm256_permute2x128_si256(first, second, 0x31));
+        data += 32;
+        hex += 64;
+        length -= 32;
+    }
+    // upper halves are cleared before legacy SSE code, transition penalty costs more than the loop
+    _mm256_zeroupper();
+    encodeSse2(data, length, hex);
+}
+
+SM_HEX_AVX2_TARGET bool decodeAvx2(const std::uint8_t* hex, size_t length, std::uint8_t* data)
+{
+    __m256i valid = _mm256_set1_epi8(-1);
+    while (length >= 32)
+    {
+        const __m256i first = toNibbles(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hex)), valid);
+        const __m256i second = toNibbles(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hex + 32)), valid);
+        const __m256i packed = _mm256_packus_epi16(joinNibbles(first), joinNibbles(second));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data), _mm256_permute4x64_epi64(packed, 0xD8));
+        hex += 64;
+        data += 32;
+        length -= 32;
+    }
+    const bool block_valid = (_mm256_movemask_epi8(valid) == -1);
+    _mm256_zeroupper();
+    return block_valid && decodeSse2(hex, length, data);
+}
+
+bool isSse2Supported()
+{
+#if defined(_MSC_VER) || defined(__x86_64__)
+    return true;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool isAvx2Supported()
+{
+#if defined(_MSC_VER)
+    // OS must save AVX state as well
+    int info[4] = {};
+    __cpuid(info, 1);
+    if (((info[2] & (1 << 27)) == 0) || ((_xgetbv(0) & 0x06) != 0x06))
+    {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // SM_HEX_SIMD
+
+struct Functions
+{
+    encode_function encode = nullptr;
+    decode_function decode = nullptr;
+};
+
+Functions getFunctions(const modbus::HexEngine engine)
+{
+    switch (engine)
+    {
+        case modbus::HexEngine::scalar:
+            return Functions{encodeScalar, decodeScalar};
+
+        case modbus::HexEngine::sse2:
+#if defined(SM_HEX_SIMD)
+            return Functions{encodeSse2, decodeSse2};
+#else
+            break;
+#endif
+
+        case modbus::HexEngine::avx2:
+#if defined(SM_HEX_SIMD)
+            return Functions{encodeAvx2, decodeAvx2};
+#else
+            break;
+#endif
+    }
+    return Functions{encodeScalar, decodeScalar};
+}
+
+modbus::HexEngine detectEngine()
+{
+#if defined(SM_HEX_SIMD)
+    if (isAvx2Supported())
+    {
+        return modbus::HexEngine::avx2;
+    }
+    if (isSse2Supported())
+    {
+        return modbus::HexEngine::sse2;
+    }
+#endif
+    return modbus::HexEngine::scalar;
+}
+
+struct ActualEngine
+{
+    std::atomic<modbus::HexEngine> engine{detectEngine()};
+    std::atomic<encode_function> encode{getFunctions(engine.load()).encode};
+    std::atomic<decode_function> decode{getFunctions(engine.load()).decode};
+};
+
+ActualEngine& actualEngine()
+{
+    static ActualEngine obj;
+    return obj;
+}
+} // namespace
+
+namespace modbus
+{
+void hexEncode(const std::uint8_t* data, const size_t length, std::uint8_t* hex)
+{
+    actualEngine().encode.load(std::memory_order_relaxed)(data, length, hex);
+}
+
+void hexEncode(const HexEngine engine, const std::uint8_t* data, const size_t length, std::uint8_t* hex)
+{
+    getFunctions(isHexEngineSupported(engine) ? engine : HexEngine::scalar).encode(data, length, hex);
+}
+
+bool hexDecode(const std::uint8_t* hex, const size_t length, std::uint8_t* data)
+{
+    return actualEngine().decode.load(std::memory_order_relaxed)(hex, length, data);
+}
+
+bool hexDecode(const HexEngine engine, const std::uint8_t* hex, const size_t length, std::uint8_t* data)
+{
+    return getFunctions(isHexEngineSupported(engine) ? engine : HexEngine::scalar).decode(hex, length, data);
+}
+
+bool isHexEngineSupported(const HexEngine engine)
+{
+    switch (engine)
+    {
+        case HexEngine::scalar:
+            return true;
+
+        case HexEngine::sse2:
+#if defined(SM_HEX_SIMD)
+            return isSse2Supported();
+#else
+            return false;
+#endif
+
+        case HexEngine::avx2:
+#if defined(SM_HEX_SIMD)
+            return isAvx2Supported() && isSse2Supported();
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+bool setHexEngine(const HexEngine engine)
+{
+    if (!isHexEngineSupported(engine))
+    {
+        return false;
+    }
+    actualEngine().encode.store(getFunctions(engine).encode, std::memory_order_relaxed);
+    actualEngine().decode.store(getFunctions(engine).decode, std::memory_order_relaxed);
+    actualEngine().engine.store(engine, std::memory_order_relaxed);
+    return true;
+}
+
+HexEngine getHexEngine() { return actualEngine().engine.load(std::memory_order_relaxed); }
+} // namespace modbus
@@ -0,0 +1,184 @@
+/**
+ * @file sm_image.cpp
+ *
+ * @brief implementation for class defined in sm_image.hpp
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include "../inc/sm_image.hpp"
+#include <map>
+#include <mutex>
+
+#if defined(PLATFORM_LINUX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(PLATFORM_WINDOWS)
+#include <windows.h>
+#endif
+
+namespace
+{
+/// @brief mappings opened by all clients of the process, keyed by file path
+std::mutex registry_mutex;
+std::map<std::string, std::weak_ptr<const sm::MappedImage>> registry;
+} // namespace
+
+namespace sm
+{
+std::shared_ptr<const MappedImage> MappedImage::open(const std::string& path_to_file)
+{
+    Stamp stamp;
+    if (!getStamp(path_to_file, stamp) || (stamp.size == 0))
+    {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto it = registry.find(path_to_file);
+    if (it != registry.end())
+    {
+        std::shared_ptr<const MappedImage> image = it->second.lock();
+        if (image && (image->stamp == stamp))
+        {
+            return image;
+        }
+    }
+    // constructor is private, make_shared can't be used
+    std::shared_ptr<MappedImage> image(new MappedImage());
+    image->stamp = stamp;
+    image->path = path_to_file;
+    if (!image->map(path_to_file))
+    {
+        return nullptr;
+    }
+    registry[path_to_file] = image;
+    // drop entries of released mappings
+    for (auto entry = registry.begin(); entry != registry.end();)
+    {
+        entry = entry->second.expired() ? registry.erase(entry) : std::next(entry);
+    }
+    return image;
+}
+
+std::uint64_t MappedImage::getHash(const std::uint8_t record_size, const std::function<std::uint64_t()>& calculate) const
+{
+    // hashes of all files opened by the process, with the file stamp they are calculated for,
+    // other users wait for the hash instead of calculating it again
+    static std::mutex hash_mutex;
+    static std::map<std::pair<std::string, std::uint8_t>, std::pair<Stamp, std::uint64_t>> hashes;
+    std::lock_guard<std::mutex> lock(hash_mutex);
+    auto& entry = hashes[{path, record_size}];
+    if (!(entry.first == stamp))
+    {
+        entry = {stamp, calculate()};
+    }
+    return entry.second;
+}
+
+bool MappedImage::map(const std::string& path_to_file)
+{
+    const size_t length = static_cast<size_t>(stamp.size);
+#if defined(PLATFORM_LINUX)
+    file_desc = ::open(path_to_file.c_str(), O_RDONLY);
+    if (file_desc == -1)
+    {
+        return false;
+    }
+    void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file_desc, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+    // records are sent from the first to the last one, aggressive read-ahead
+    // keeps pages ready before the exchange needs them
+    (void)madvise(mapping, length, MADV_SEQUENTIAL);
+    view = static_cast<const std::uint8_t*>(mapping);
+#elif defined(PLATFORM_WINDOWS)
+    file_handle = CreateFileA(path_to_file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        file_handle = nullptr;
+        return false;
+    }
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_handle == nullptr)
+    {
+        return false;
+    }
+    view = static_cast<const std::uint8_t*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, length));
+    if (view == nullptr)
+    {
+        return false;
+    }
+#else
+    (void)path_to_file;
+    return false;
+#endif
+    size = length;
+    return true;
+}
+
+void MappedImage::unmap()
+{
+#if defined(PLATFORM_LINUX)
+    if (view != nullptr)
+    {
+        munmap(const_cast<std::uint8_t*>(view), size);
+    }
+    if (file_desc != -1)
+    {
+        ::close(file_desc);
+    }
+#elif defined(PLATFORM_WINDOWS)
+    if (view != nullptr)
+    {
+        UnmapViewOfFile(view);
+    }
+    if (mapping_handle != nullptr)
+    {
+        CloseHandle(mapping_handle);
+    }
+    if (file_handle != nullptr)
+    {
+        CloseHandle(file_handle);
+    }
+#endif
+    view = nullptr;
+    size = 0;
+    file_desc = -1;
+    file_handle = nullptr;
+    mapping_handle = nullptr;
+}
+
+bool MappedImage::getStamp(const std::string& path_to_file, Stamp& stamp)
+{
+#if defined(PLATFORM_LINUX)
+    struct stat info;
+    if ((::stat(path_to_file.c_str(), &info) != 0) || !S_ISREG(info.st_mode))
+    {
+        return false;
+    }
+    stamp.size = static_cast<std::uint64_t>(info.st_size);
+    stamp.modified = (static_cast<std::uint64_t>(info.st_mtim.tv_sec) * 1000000000ULL) + static_cast<std::uint64_t>(info.st_mtim.tv_nsec);
+    stamp.inode = static_cast<std::uint64_t>(info.st_ino);
+    return true;
+#elif defined(PLATFORM_WINDOWS)
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path_to_file.c_str(), GetFileExInfoStandard, &info) || (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        return false;
+    }
+    stamp.size = (static_cast<std::uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    stamp.modified = (static_cast<std::uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+    return true;
+#else
+    (void)path_to_file;
+    (void)stamp;
+    return false;
+#endif
+}
+} // namespace sm
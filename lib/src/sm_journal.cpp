@@ -0,0 +1,215 @@
+/**
+ * @file sm_journal.cpp
+ *
+ * @brief implementation for class defined in sm_journal.hpp
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include "../inc/sm_journal.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+#if defined(PLATFORM_LINUX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#elif defined(PLATFORM_WINDOWS)
+#include <windows.h>
+#endif
+
+namespace
+{
+constexpr std::uint64_t fnv_prime = 0x100000001B3ULL;
+} // namespace
+
+namespace sm
+{
+bool Journal::open(const std::string& directory, const std::string& port, const std::uint8_t address, const std::uint64_t image_hash,
+                   const std::uint32_t num_of_records, const std::uint16_t record_size)
+{
+    close();
+    path = getPath(directory, port, address);
+    if (!map(sizeof(Header) + ((static_cast<size_t>(num_of_records) + 7U) / 8U)))
+    {
+        close();
+        return false;
+    }
+    if ((header->magic != journal_magic) || (header->version != journal_version) || (header->num_of_records != num_of_records) ||
+        (header->record_size != record_size) || (header->address != address) || (header->image_hash != image_hash))
+    {
+        // journal of another upload, start from scratch
+        header->magic = journal_magic;
+        header->version = journal_version;
+        header->num_of_records = num_of_records;
+        header->record_size = record_size;
+        header->address = address;
+        header->reserved = 0;
+        header->image_hash = image_hash;
+        reset();
+    }
+    return true;
+}
+
+void Journal::close()
+{
+#if defined(PLATFORM_LINUX)
+    if (header != nullptr)
+    {
+        munmap(header, mapped_size);
+    }
+    if (file_desc != -1)
+    {
+        ::close(file_desc);
+    }
+#elif defined(PLATFORM_WINDOWS)
+    if (header != nullptr)
+    {
+        FlushViewOfFile(header, mapped_size);
+        UnmapViewOfFile(header);
+    }
+    if (mapping_handle != nullptr)
+    {
+        CloseHandle(mapping_handle);
+    }
+    if (file_handle != nullptr)
+    {
+        CloseHandle(file_handle);
+    }
+#endif
+    header = nullptr;
+    bitmap = nullptr;
+    mapped_size = 0;
+    file_desc = -1;
+    file_handle = nullptr;
+    mapping_handle = nullptr;
+}
+
+void Journal::remove()
+{
+    close();
+    if (!path.empty())
+    {
+        std::remove(path.c_str());
+    }
+}
+
+void Journal::reset()
+{
+    if (isOpen())
+    {
+        std::memset(bitmap, 0, mapped_size - sizeof(Header));
+    }
+}
+
+void Journal::setAcknowledged(const int first_record, const int count)
+{
+    if (!isOpen())
+    {
+        return;
+    }
+    for (int record = first_record; (record < (first_record + count)) && (static_cast<std::uint32_t>(record) < header->num_of_records); ++record)
+    {
+        bitmap[record / 8] |= static_cast<std::uint8_t>(1U << (record % 8));
+    }
+}
+
+bool Journal::isAcknowledged(const int record) const
+{
+    if (!isOpen() || (record < 0) || (static_cast<std::uint32_t>(record) >= header->num_of_records))
+    {
+        return false;
+    }
+    return (bitmap[record / 8] & (1U << (record % 8))) != 0;
+}
+
+int Journal::getNumOfAcknowledged() const
+{
+    int counter = 0;
+    for (int record = 0; isOpen() && (static_cast<std::uint32_t>(record) < header->num_of_records); ++record)
+    {
+        counter += isAcknowledged(record) ? 1 : 0;
+    }
+    return counter;
+}
+
+int Journal::getLastAcknowledged() const
+{
+    for (int record = isOpen() ? (static_cast<int>(header->num_of_records) - 1) : -1; record >= 0; --record)
+    {
+        if (isAcknowledged(record))
+        {
+            return record;
+        }
+    }
+    return -1;
+}
+
+std::uint64_t Journal::hashImage(const std::uint8_t* data, const size_t length, const std::uint64_t hash_init)
+{
+    std::uint64_t hash = hash_init;
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= data[i];
+        hash *= fnv_prime;
+    }
+    return hash;
+}
+
+void Journal::discard(const std::string& directory, const std::string& port, const std::uint8_t address)
+{
+    std::remove(getPath(directory, port, address).c_str());
+}
+
+bool Journal::map(const size_t size)
+{
+    void* view = nullptr;
+#if defined(PLATFORM_LINUX)
+    file_desc = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if ((file_desc == -1) || (ftruncate(file_desc, static_cast<off_t>(size)) != 0))
+    {
+        return false;
+    }
+    // shared mapping reaches the file even if the process is killed
+    view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_desc, 0);
+    if (view == MAP_FAILED)
+    {
+        return false;
+    }
+#elif defined(PLATFORM_WINDOWS)
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        file_handle = nullptr;
+        return false;
+    }
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(size), nullptr);
+    if (mapping_handle == nullptr)
+    {
+        return false;
+    }
+    view = MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, size);
+    if (view == nullptr)
+    {
+        return false;
+    }
+#else
+    (void)size;
+    return false;
+#endif
+    header = static_cast<Header*>(view);
+    bitmap = static_cast<std::uint8_t*>(view) + sizeof(Header);
+    mapped_size = size;
+    return true;
+}
+
+std::string Journal::getPath(const std::string& directory, const std::string& port, const std::uint8_t address)
+{
+    std::string name = port;
+    std::replace_if(name.begin(), name.end(), [](const char c) { return std::isalnum(static_cast<unsigned char>(c)) == 0; }, '_');
+    return directory + "/sm_journal_" + name + "_" + std::to_string(address) + ".bin";
+}
+} // namespace sm
@@ -8,6 +8,9 @@
  */
 
 #include "../inc/sm_modbus.hpp"
+#include "../inc/sm_hex.hpp"
+#include <algorithm>
+#include <cstring>
 
 namespace
 {
@@ -15,11 +18,127 @@ constexpr std::uint8_t rtu_start_end[] = {0x00, 0x00, 0x00, 0x00};
 constexpr std::uint8_t ascii_start[] = {0x3A};
 constexpr std::uint8_t ascii_stop[] = {0x0D, 0x0A};
 
-static void insertHalfWord(std::vector<std::uint8_t>& arr, const std::uint16_t value)
+/// @brief writes ADU directly to the frame: space for the start sequence is
+/// reserved up front and crc is updated while PDU bytes are written; ASCII
+/// message is collected in binary and hex encoded at once with LRC on finish
+class FrameWriter
 {
-    arr.push_back((value >> 8) & 0xFF);
-    arr.push_back(value & 0xFF);
-}
+public:
+    FrameWriter(modbus::Frame& frame, const modbus::ModbusMode mode, const bool rtu_padding)
+        : frame(frame), mode(mode), rtu_padding(rtu_padding)
+    {
+        switch (mode)
+        {
+            case modbus::ModbusMode::rtu:
+                if (rtu_padding)
+                {
+                    putRaw(rtu_start_end, sizeof(rtu_start_end));
+                }
+                break;
+
+            case modbus::ModbusMode::ascii:
+                putRaw(ascii_start, sizeof(ascii_start));
+                break;
+        }
+    }
+    void put(const std::uint8_t value) { put(&value, 1); }
+    void putHalfWord(const std::uint16_t value)
+    {
+        const std::uint8_t half_word[2] = {static_cast<std::uint8_t>((value >> 8) & 0xFF), static_cast<std::uint8_t>(value & 0xFF)};
+        put(half_word, sizeof(half_word));
+    }
+    void put(const std::uint8_t* data, const size_t length)
+    {
+        switch (mode)
+        {
+            case modbus::ModbusMode::rtu:
+                if (putRaw(data, length))
+                {
+                    crc = modbus::crc16(data, length, crc);
+                }
+                break;
+
+            case modbus::ModbusMode::ascii:
+                if (overflow || ((message_length + length) > (message.size() - modbus::lrc_size)))
+                {
+                    overflow = true;
+                    break;
+                }
+                std::memcpy(message.data() + message_length, data, length);
+                message_length += length;
+                break;
+        }
+    }
+    /// @brief write crc (or LRC) and stop sequence
+    /// @return ADU length, 0 in case of buffer overflow
+    size_t finish()
+    {
+        switch (mode)
+        {
+            case modbus::ModbusMode::rtu:
+            {
+                const std::uint8_t crc_bytes[modbus::crc_size] = {static_cast<std::uint8_t>((crc >> 8) & 0xFF), static_cast<std::uint8_t>(crc & 0xFF)};
+                putRaw(crc_bytes, sizeof(crc_bytes));
+                if (rtu_padding)
+                {
+                    putRaw(rtu_start_end, sizeof(rtu_start_end));
+                }
+                break;
+            }
+
+            case modbus::ModbusMode::ascii:
+            {
+                const std::uint8_t lrc = modbus::calcLrc(message.data(), message_length);
+                message[message_length++] = lrc;
+                std::uint8_t* hex = reserve(2 * message_length);
+                if (hex != nullptr)
+                {
+                    modbus::hexEncode(message.data(), message_length, hex);
+                }
+                putRaw(ascii_stop, sizeof(ascii_stop));
+                break;
+            }
+        }
+        frame.resize(overflow ? 0 : position);
+        return frame.size();
+    }
+
+private:
+    modbus::Frame& frame;
+    const modbus::ModbusMode mode;
+    const bool rtu_padding;
+    size_t position = 0;
+    std::uint16_t crc = modbus::crc16_init;
+    bool overflow = false;
+    /// @brief binary ASCII message: address, PDU and LRC
+    std::array<std::uint8_t, modbus::address_size + modbus::max_pdu_size + modbus::lrc_size> message;
+    size_t message_length = 0;
+
+    /// @brief reserve space in the frame
+    /// @param length amount of bytes to reserve
+    /// @return pointer to reserved space, nullptr in case of buffer overflow
+    std::uint8_t* reserve(const size_t length)
+    {
+        if (overflow || ((position + length) > modbus::Frame::capacity()))
+        {
+            overflow = true;
+            return nullptr;
+        }
+        std::uint8_t* space = frame.data() + position;
+        position += length;
+        return space;
+    }
+    bool putRaw(const std::uint8_t* data, const size_t length)
+    {
+        std::uint8_t* space = reserve(length);
+        if (space == nullptr)
+        {
+            return false;
+        }
+        std::memcpy(space, data, length);
+        return true;
+    }
+};
 
 struct Sizes
 {
@@ -28,7 +147,7 @@ struct Sizes
     int adu_header_size;
 };
 
-Sizes get_sizes(modbus::ModbusMode mode)
+Sizes get_sizes(modbus::ModbusMode mode, bool rtu_padding)
 {
     switch (mode)
     {
@@ -37,6 +156,10 @@ Sizes get_sizes(modbus::ModbusMode mode)
             return Sizes{modbus::ascii_start_size, modbus::ascii_stop_size, modbus::ascii_adu_size};
 
         case modbus::ModbusMode::rtu:
+            if (!rtu_padding)
+            {
+                return Sizes{0, 0, modbus::rtu_adu_size - modbus::rtu_msg_edge};
+            }
             return Sizes{modbus::rtu_start_size, modbus::rtu_stop_size, modbus::rtu_adu_size};
     }
     return {};
@@ -47,61 +170,263 @@ namespace modbus
 {
 std::vector<std::uint8_t>& ModbusClient::msgCustom(const std::uint8_t addr, const std::uint8_t func, const std::vector<std::uint8_t>& data)
 {
-    createMessage(addr, func, data);
-    return buffer;
+    (void)encodeCustom(frame, addr, func, data.data(), data.size());
+    return frameToBuffer();
 }
 
 std::vector<std::uint8_t>& ModbusClient::msgWriteFileRecord(const std::uint8_t addr, const std::uint16_t file_id, const std::uint16_t record_id,
                                                             const std::vector<std::uint8_t>& record_data)
 {
-    const std::uint8_t rec_data_length = record_data.size() + 7; // 7 additional bytes for record data
-    const std::uint16_t record_length = record_data.size() / 2;  // record splited into half words
-    std::vector<std::uint8_t> record;
-
-    record.insert(record.end(), {rec_data_length, 0x06U});
-    insertHalfWord(record, file_id);
-    insertHalfWord(record, record_id);
-    insertHalfWord(record, record_length);
-    record.insert(record.end(), record_data.begin(), record_data.end());
-    createMessage(addr, static_cast<std::uint8_t>(FunctionCodes::write_file), record);
-    return buffer;
+    (void)encodeWriteFileRecord(frame, addr, file_id, record_id, record_data.data(), record_data.size());
+    return frameToBuffer();
 }
 
 std::vector<std::uint8_t>& ModbusClient::msgReadFileRecord(const std::uint8_t addr, const std::uint16_t file_id, const std::uint16_t record_id,
                                                            const std::uint16_t length)
 {
-    std::vector<uint8_t> record;
-    record.insert(record.end(), {0x07, 0x06}); // 7 bytes in this message (support for reading
-                                               // only one record per message)
-    insertHalfWord(record, file_id);
-    insertHalfWord(record, record_id);
-    insertHalfWord(record, length);
-    createMessage(addr, static_cast<std::uint8_t>(FunctionCodes::read_file), record);
-    return buffer;
+    (void)encodeReadFileRecord(frame, addr, file_id, record_id, length);
+    return frameToBuffer();
 }
 
 std::vector<std::uint8_t>& ModbusClient::msgWriteRegister(const std::uint8_t addr, const std::uint16_t reg, const std::uint16_t value)
 {
-    std::vector<uint8_t> data;
-    insertHalfWord(data, reg);
-    insertHalfWord(data, value);
-    createMessage(addr, static_cast<std::uint8_t>(FunctionCodes::write_register), data);
-    return buffer;
+    (void)encodeWriteRegister(frame, addr, reg, value);
+    return frameToBuffer();
+}
+
+std::vector<std::uint8_t>& ModbusClient::msgWriteRegisters(const std::uint8_t addr, const std::uint16_t reg, const std::vector<std::uint16_t>& values)
+{
+    (void)encodeWriteRegisters(frame, addr, reg, values.data(), values.size());
+    return frameToBuffer();
 }
 
 std::vector<std::uint8_t>& ModbusClient::msgReadRegisters(const std::uint8_t addr, const std::uint16_t reg, const std::uint16_t quantity)
 {
-    std::vector<std::uint8_t> data;
-    insertHalfWord(data, reg);
-    insertHalfWord(data, quantity);
-    createMessage(addr, static_cast<std::uint8_t>(FunctionCodes::read_registers), data);
-    return buffer;
+    (void)encodeReadRegisters(frame, addr, reg, quantity);
+    return frameToBuffer();
+}
+
+size_t ModbusClient::encodeCustom(Frame& frame, const std::uint8_t addr, const std::uint8_t func, const std::uint8_t* data, const size_t length) const
+{
+    FrameWriter writer(frame, mode, rtu_padding);
+    writer.put(addr);
+    writer.put(func);
+    writer.put(data, length);
+    return writer.finish();
+}
+
+size_t ModbusClient::encodeWriteFileRecord(Frame& frame, const std::uint8_t addr, const std::uint16_t file_id, const std::uint16_t record_id,
+                                           const std::uint8_t* record_data, const size_t length) const
+{
+    FileRecord record;
+    record.file_id = file_id;
+    record.record_id = record_id;
+    record.data = record_data;
+    record.length = static_cast<std::uint16_t>(length);
+    return encodeWriteFileRecords(frame, addr, &record, 1);
+}
+
+size_t ModbusClient::encodeReadFileRecord(Frame& frame, const std::uint8_t addr, const std::uint16_t file_id, const std::uint16_t record_id,
+                                          const std::uint16_t length) const
+{
+    FileRecord record;
+    record.file_id = file_id;
+    record.record_id = record_id;
+    record.length = length * 2; // length is passed in half words
+    return encodeReadFileRecords(frame, addr, &record, 1);
+}
+
+size_t ModbusClient::encodeWriteFileRecords(Frame& frame, const std::uint8_t addr, const FileRecord* records, const size_t count) const
+{
+    size_t byte_count = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        byte_count += file_sub_request_size + records[i].length;
+    }
+    // function code and byte count are the rest of PDU
+    if ((count == 0) || ((byte_count + 2) > max_pdu_size))
+    {
+        frame.clear();
+        return 0;
+    }
+    FrameWriter writer(frame, mode, rtu_padding);
+    writer.put(addr);
+    writer.put(static_cast<std::uint8_t>(FunctionCodes::write_file));
+    writer.put(static_cast<std::uint8_t>(byte_count));
+    for (size_t i = 0; i < count; ++i)
+    {
+        writer.put(file_reference_type);
+        writer.putHalfWord(records[i].file_id);
+        writer.putHalfWord(records[i].record_id);
+        writer.putHalfWord(records[i].length / 2); // record splited into half words
+        writer.put(records[i].data, records[i].length);
+    }
+    return writer.finish();
+}
+
+size_t ModbusClient::encodeReadFileRecords(Frame& frame, const std::uint8_t addr, const FileRecord* records, const size_t count) const
+{
+    // every sub-response has length and reference type bytes before record data
+    size_t response_count = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        response_count += 2 + records[i].length;
+    }
+    const size_t byte_count = count * file_sub_request_size;
+    if ((count == 0) || ((byte_count + 2) > max_pdu_size) || ((response_count + 2) > max_pdu_size))
+    {
+        frame.clear();
+        return 0;
+    }
+    FrameWriter writer(frame, mode, rtu_padding);
+    writer.put(addr);
+    writer.put(static_cast<std::uint8_t>(FunctionCodes::read_file));
+    writer.put(static_cast<std::uint8_t>(byte_count));
+    for (size_t i = 0; i < count; ++i)
+    {
+        writer.put(file_reference_type);
+        writer.putHalfWord(records[i].file_id);
+        writer.putHalfWord(records[i].record_id);
+        writer.putHalfWord(records[i].length / 2);
+    }
+    return writer.finish();
+}
+
+size_t ModbusClient::getMaxFileRecords(const FunctionCodes code, const size_t record_size)
+{
+    // function code and byte count are the rest of PDU
+    const size_t max_byte_count = max_pdu_size - 2;
+    size_t records = 0;
+    switch (code)
+    {
+        case FunctionCodes::write_file:
+            // response is an echo of the request
+            records = max_byte_count / (file_sub_request_size + record_size);
+            break;
+
+        case FunctionCodes::read_file:
+            records = max_byte_count / (2 + record_size);
+            records = (records < static_cast<size_t>(max_file_records)) ? records : max_file_records;
+            break;
+
+        default:
+            break;
+    }
+    return records;
+}
+
+size_t ModbusClient::encodeWriteRegister(Frame& frame, const std::uint8_t addr, const std::uint16_t reg, const std::uint16_t value) const
+{
+    FrameWriter writer(frame, mode, rtu_padding);
+    writer.put(addr);
+    writer.put(static_cast<std::uint8_t>(FunctionCodes::write_register));
+    writer.putHalfWord(reg);
+    writer.putHalfWord(value);
+    return writer.finish();
+}
+
+size_t ModbusClient::encodeWriteRegisters(Frame& frame, const std::uint8_t addr, const std::uint16_t reg, const std::uint16_t* values,
+                                          const size_t quantity) const
+{
+    if ((quantity == 0) || (quantity > static_cast<size_t>(max_write_registers)))
+    {
+        frame.clear();
+        return 0;
+    }
+    FrameWriter writer(frame, mode, rtu_padding);
+    writer.put(addr);
+    writer.put(static_cast<std::uint8_t>(FunctionCodes::write_registers));
+    writer.putHalfWord(reg);
+    writer.putHalfWord(static_cast<std::uint16_t>(quantity));
+    writer.put(static_cast<std::uint8_t>(quantity * 2));
+    for (size_t i = 0; i < quantity; ++i)
+    {
+        writer.putHalfWord(values[i]);
+    }
+    return writer.finish();
+}
+
+size_t ModbusClient::encodeReadRegisters(Frame& frame, const std::uint8_t addr, const std::uint16_t reg, const std::uint16_t quantity) const
+{
+    FrameWriter writer(frame, mode, rtu_padding);
+    writer.put(addr);
+    writer.put(static_cast<std::uint8_t>(FunctionCodes::read_registers));
+    writer.putHalfWord(reg);
+    writer.putHalfWord(quantity);
+    return writer.finish();
+}
+
+bool ModbusClient::restampAddress(std::uint8_t* adu, const size_t size, const std::uint8_t addr) const
+{
+    const Sizes sizes = get_sizes(mode, rtu_padding);
+    const size_t edges = static_cast<size_t>(sizes.start_seq_size + sizes.stop_seq_size);
+    if (mode == ModbusMode::ascii)
+    {
+        if (size < (edges + 2 * (address_size + function_size + 1 + lrc_size)))
+        {
+            return false;
+        }
+        // LRC is a plain sum, so it is changed by the address difference
+        std::uint8_t* addr_hex = adu + sizes.start_seq_size;
+        std::uint8_t* lrc_hex = adu + size - sizes.stop_seq_size - 2 * lrc_size;
+        std::uint8_t old_addr = 0;
+        std::uint8_t lrc = 0;
+        if (!hexDecode(addr_hex, address_size, &old_addr) || !hexDecode(lrc_hex, lrc_size, &lrc))
+        {
+            return false;
+        }
+        lrc = static_cast<std::uint8_t>(lrc + old_addr - addr);
+        hexEncode(&addr, address_size, addr_hex);
+        hexEncode(&lrc, lrc_size, lrc_hex);
+        return true;
+    }
+    if (size < (edges + min_frame_size))
+    {
+        return false;
+    }
+    std::uint8_t* message = adu + sizes.start_seq_size;
+    const size_t message_size = size - edges - crc_size;
+    // address is the only changed byte, PDU is not read again
+    const std::uint16_t old_crc = static_cast<std::uint16_t>((message[message_size] << 8) | message[message_size + 1]);
+    const std::uint16_t crc = crc16Patch(old_crc, message_size, 0, message[0], addr);
+    message[0] = addr;
+    message[message_size] = static_cast<std::uint8_t>((crc >> 8) & 0xFF);
+    message[message_size + 1] = static_cast<std::uint8_t>(crc & 0xFF);
+    return true;
+}
+
+bool ModbusClient::decodeMessageHead(const std::uint8_t* adu, const size_t size, std::uint8_t* message, const size_t length) const
+{
+    const Sizes sizes = get_sizes(mode, rtu_padding);
+    const size_t chars_per_byte = (mode == ModbusMode::ascii) ? 2 : 1;
+    if (size < (static_cast<size_t>(sizes.start_seq_size + sizes.stop_seq_size) + chars_per_byte * length))
+    {
+        return false;
+    }
+    if (mode == ModbusMode::ascii)
+    {
+        return hexDecode(adu + sizes.start_seq_size, length, message);
+    }
+    std::memcpy(message, adu + sizes.start_seq_size, length);
+    return true;
 }
 
 bool ModbusClient::isChecksumValid(const std::vector<std::uint8_t>& data)
 {
-    std::vector<std::uint8_t> message;
-    Sizes sizes = get_sizes(mode);
+    Sizes sizes = get_sizes(mode, rtu_padding);
+
+    if (mode == ModbusMode::ascii)
+    {
+        const size_t hex_size = data.size() - sizes.start_seq_size - sizes.stop_seq_size;
+        std::array<std::uint8_t, max_frame_size / 2> message;
+        if ((data.size() < static_cast<size_t>(sizes.adu_header_size)) || (hex_size % 2) || ((hex_size / 2) > message.size()) ||
+            !hexDecode(data.data() + sizes.start_seq_size, hex_size / 2, message.data()))
+        {
+            return false;
+        }
+        const size_t message_size = hex_size / 2 - lrc_size;
+        return calcLrc(message.data(), message_size) == message[message_size];
+    }
 
     const int crc_idx = data.size() - sizes.stop_seq_size - crc_size;
     if (data.size() <= static_cast<size_t>(sizes.adu_header_size))
@@ -110,10 +435,11 @@ bool ModbusClient::isChecksumValid(const std::vector<std::uint8_t>& data)
     }
     else
     {
-        message.insert(message.end(), data.begin() + sizes.start_seq_size, data.end() - sizes.stop_seq_size - crc_size);
+        const std::uint8_t* message = data.data() + sizes.start_seq_size;
+        const size_t message_size = crc_idx - sizes.start_seq_size;
         std::uint16_t rec_crc = data[crc_idx];
         rec_crc = (rec_crc << 8) | data[crc_idx + 1];
-        std::uint16_t actual_crc = crc16(message);
+        std::uint16_t actual_crc = crc16(message, message_size);
         if (actual_crc == rec_crc)
         {
             return true;
@@ -127,73 +453,358 @@ bool ModbusClient::isChecksumValid(const std::vector<std::uint8_t>& data)
 
 void ModbusClient::extractData(const std::vector<std::uint8_t>& data, std::vector<std::uint8_t>& message)
 {
-    Sizes sizes = get_sizes(mode);
+    Sizes sizes = get_sizes(mode, rtu_padding);
+    if (data.size() < static_cast<size_t>(sizes.start_seq_size + sizes.stop_seq_size))
+    {
+        return;
+    }
+    if (mode == ModbusMode::ascii)
+    {
+        const size_t length = (data.size() - sizes.start_seq_size - sizes.stop_seq_size) / 2;
+        const size_t offset = message.size();
+        message.resize(offset + length);
+        if (!hexDecode(data.data() + sizes.start_seq_size, length, message.data() + offset))
+        {
+            message.resize(offset);
+        }
+        return;
+    }
     message.insert(message.end(), data.begin() + sizes.start_seq_size, data.end() - sizes.stop_seq_size);
 }
 
-std::uint8_t ModbusClient::getRequriedLength() const
+std::uint8_t ModbusClient::getRequriedLength() const { return get_sizes(mode, rtu_padding).adu_header_size; }
+
+size_t ModbusClient::getAduSize(const size_t pdu_size) const
 {
-    std::uint8_t length = 0;
-    switch (mode)
+    const size_t chars_per_byte = (mode == ModbusMode::ascii) ? 2 : 1;
+    return get_sizes(mode, rtu_padding).adu_header_size + chars_per_byte * pdu_size;
+}
+
+void FrameParser::reset(const ModbusMode new_mode, const bool padding, const FrameDirection new_direction)
+{
+    mode = new_mode;
+    rtu_padding = padding;
+    direction = new_direction;
+    reset();
+}
+
+void FrameParser::reset()
+{
+    status = ParserStatus::incomplete;
+    length = 0;
+    expected = 0;
+    stop_received = 0;
+    started = false;
+    char_pending = false;
+}
+
+ParserStatus FrameParser::push(const std::uint8_t value)
+{
+    if (status != ParserStatus::incomplete)
+    {
+        return status;
+    }
+    if (!started)
+    {
+        // RTU start sequence is zero padding, server address is never 0 in response,
+        // zeros are skipped even without padding to drop stop sequence of previous frame,
+        // unpadded requests may start with broadcast address
+        switch (mode)
+        {
+            case ModbusMode::rtu:
+                started = (value != rtu_start_end[0]) || ((direction == FrameDirection::request) && !rtu_padding);
+                break;
+
+            case ModbusMode::ascii:
+                started = (value == ascii_start[0]);
+                return status;
+        }
+        if (!started)
+        {
+            return status;
+        }
+    }
+    if (mode == ModbusMode::ascii)
     {
-        case ModbusMode::rtu:
-            length = rtu_adu_size;
+        pushAscii(value);
+    }
+    else
+    {
+        store(value);
+        if (length == expected)
+        {
+            status = ParserStatus::complete;
+        }
+    }
+    return status;
+}
+
+size_t FrameParser::push(const std::uint8_t* data, const size_t count)
+{
+    size_t consumed = 0;
+    while ((consumed < count) && (status == ParserStatus::incomplete))
+    {
+        // frame body of known length is copied (or decoded) in bulk, a broken
+        // character or a new start inside ASCII frame is handled byte by byte
+        if (started && !char_pending && (expected != 0) && (length < expected))
+        {
+            if (mode == ModbusMode::rtu)
+            {
+                const size_t bytes = std::min(count - consumed, expected - length);
+                std::memcpy(frame.data() + length, data + consumed, bytes);
+                length += bytes;
+                consumed += bytes;
+                status = (length == expected) ? ParserStatus::complete : status;
+                continue;
+            }
+            const size_t pairs = std::min((count - consumed) / 2, expected - length);
+            if ((pairs > 0) && hexDecode(data + consumed, pairs, frame.data() + length))
+            {
+                length += pairs;
+                consumed += 2 * pairs;
+                continue;
+            }
+        }
+        push(data[consumed++]);
+    }
+    return consumed;
+}
+
+void FrameParser::store(const std::uint8_t value)
+{
+    if (length >= frame.size())
+    {
+        status = ParserStatus::error;
+        return;
+    }
+    frame[length++] = value;
+    if (expected == 0)
+    {
+        updateExpectedLength();
+    }
+}
+
+void FrameParser::pushAscii(const std::uint8_t value)
+{
+    if (value == ascii_start[0])
+    {
+        // start of a new frame drops the broken one
+        length = 0;
+        expected = 0;
+        stop_received = 0;
+        char_pending = false;
+        return;
+    }
+    if ((expected == 0) || (length < expected))
+    {
+        if (!char_pending)
+        {
+            pending_char = value;
+            char_pending = true;
+            return;
+        }
+        char_pending = false;
+        const std::uint8_t hex[2] = {pending_char, value};
+        std::uint8_t decoded = 0;
+        if (!hexDecode(hex, 1, &decoded))
+        {
+            status = ParserStatus::error;
+            return;
+        }
+        store(decoded);
+    }
+    else if (value != ascii_stop[stop_received])
+    {
+        status = ParserStatus::error;
+    }
+    else if (++stop_received == sizeof(ascii_stop))
+    {
+        status = ParserStatus::complete;
+    }
+}
+
+size_t FrameParser::getBytesToRead() const
+{
+    if (status != ParserStatus::incomplete)
+    {
+        return 0;
+    }
+    if (!started)
+    {
+        // no frame is shorter than min_frame_size, so start sequence and the frame
+        // beginning can be read at once without touching the next frame
+        return (mode == ModbusMode::rtu) ? min_frame_size : ascii_start_size;
+    }
+    // request header may be longer than the shortest frame
+    const size_t min_size = address_size + function_size + 1 + getChecksumSize(mode);
+    const size_t missing = (expected != 0) ? (expected - length) : ((length < min_size) ? (min_size - length) : 1);
+    if (mode == ModbusMode::rtu)
+    {
+        return missing;
+    }
+    // two characters per decoded byte
+    const size_t pending = char_pending ? 1 : 0;
+    const size_t stop_size = (expected != 0) ? (sizeof(ascii_stop) - stop_received) : 0;
+    return 2 * missing - pending + stop_size;
+}
+
+size_t FrameParser::getAduSize() const
+{
+    Sizes sizes = get_sizes(mode, rtu_padding);
+    const size_t chars_per_byte = (mode == ModbusMode::ascii) ? 2 : 1;
+    return chars_per_byte * length + sizes.start_seq_size + sizes.stop_seq_size;
+}
+
+bool FrameParser::isException() const { return (length > address_size) && (frame[address_size] & exception_flag); }
+
+bool FrameParser::isChecksumValid() const
+{
+    const size_t checksum_size = getChecksumSize(mode);
+    if ((status != ParserStatus::complete) || (length < (address_size + function_size + 1 + checksum_size)))
+    {
+        return false;
+    }
+    if (mode == ModbusMode::ascii)
+    {
+        return calcLrc(frame.data(), length - lrc_size) == frame[length - lrc_size];
+    }
+    std::uint16_t rec_crc = frame[length - crc_size];
+    rec_crc = (rec_crc << 8) | frame[length - crc_size + 1];
+    return crc16(frame.data(), length - crc_size) == rec_crc;
+}
+
+void FrameParser::updateExpectedLength()
+{
+    const size_t header_size = address_size + function_size;
+    const size_t checksum_size = getChecksumSize(mode);
+    if (length < header_size)
+    {
+        return;
+    }
+    if (direction == FrameDirection::request)
+    {
+        updateExpectedRequestLength();
+        return;
+    }
+    const std::uint8_t function = frame[address_size];
+    if (function & exception_flag)
+    {
+        // exception code only
+        expected = header_size + 1 + checksum_size;
+        return;
+    }
+    switch (static_cast<FunctionCodes>(function))
+    {
+        case FunctionCodes::write_register:
+        case FunctionCodes::write_registers:
+            // echo of register address and value (or quantity)
+            expected = header_size + 4 + checksum_size;
+            break;
+
+        case FunctionCodes::read_registers:
+        case FunctionCodes::read_file:
+        case FunctionCodes::write_file:
+            // byte count field first
+            if (length > header_size)
+            {
+                expected = header_size + 1 + frame[header_size] + checksum_size;
+            }
             break;
 
-        case ModbusMode::ascii:
-            length = ascii_adu_size;
+        default:
+            status = ParserStatus::error;
             break;
     }
-    return length;
 }
 
-void ModbusClient::createMessage(const std::uint8_t addr, const std::uint8_t func, const std::vector<std::uint8_t>& data)
+void FrameParser::updateExpectedRequestLength()
 {
-    buffer.clear();
-    // setup PDU
-    buffer.insert(buffer.end(), {addr, func});
-    buffer.insert(buffer.end(), data.begin(), data.end());
-    uint16_t crc = crc16(buffer);
-    insertHalfWord(buffer, crc);
-    // setup ADU
-    switch (mode)
+    const size_t header_size = address_size + function_size;
+    const size_t checksum_size = getChecksumSize(mode);
+    switch (static_cast<FunctionCodes>(frame[address_size]))
     {
-        case ModbusMode::rtu:
-            buffer.insert(buffer.begin(), &rtu_start_end[0], &rtu_start_end[0] + sizeof(rtu_start_end));
-            buffer.insert(buffer.end(), &rtu_start_end[0], &rtu_start_end[0] + sizeof(rtu_start_end));
+        case FunctionCodes::read_file:
+        case FunctionCodes::write_file:
+            // byte count field first
+            if (length > header_size)
+            {
+                expected = header_size + 1 + frame[header_size] + checksum_size;
+            }
             break;
 
-        case ModbusMode::ascii:
-            buffer.insert(buffer.begin(), &ascii_start[0], &ascii_start[0] + sizeof(ascii_start));
-            buffer.insert(buffer.end(), &ascii_stop[0], &ascii_stop[0] + sizeof(ascii_stop));
+        case FunctionCodes::write_registers:
+            // register address, quantity, then byte count field
+            if (length > (header_size + 4))
+            {
+                expected = header_size + 5 + frame[header_size + 4] + checksum_size;
+            }
+            break;
+
+        default:
+            // register address and value or quantity, the same layout is used
+            // by most fixed size requests, including ping with illegal function
+            expected = header_size + 4 + checksum_size;
             break;
     }
 }
 
-std::uint16_t ModbusClient::crc16(const std::vector<std::uint8_t>& data)
+std::uint8_t calcLrc(const std::uint8_t* data, const size_t length)
 {
-    const std::uint16_t ibm_poly = 0xA001U;
-    std::uint16_t result = 0xFFFFU;
-
-    auto ibm_byte{[](std::uint16_t crc, std::uint8_t data) -> std::uint16_t
+    // eight bytes at a time, odd and even bytes are summed in 16-bit lanes
+    // which cannot overflow within a block of 128 words
+    const std::uint64_t low_bytes = 0x00FF00FF00FF00FFULL;
+    const size_t words_per_block = 128;
+    std::uint64_t sum = 0;
+    size_t i = 0;
+    while ((length - i) >= sizeof(std::uint64_t))
     {
-        const std::uint16_t table[2] = {0x0000, ibm_poly};
-        std::uint8_t xOr = 0;
-        crc ^= data;
-        for (std::uint8_t bit = 0; bit < 8; bit++)
+        const size_t words = std::min((length - i) / sizeof(std::uint64_t), words_per_block);
+        std::uint64_t lanes = 0;
+        for (size_t j = 0; j < words; ++j, i += sizeof(std::uint64_t))
         {
-            xOr = crc & 0x01;
-            crc >>= 1;
-            crc ^= table[xOr];
+            std::uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            lanes += (word & low_bytes) + ((word >> 8) & low_bytes);
         }
-        return crc;
-    }};
+        sum += lanes + (lanes >> 16) + (lanes >> 32) + (lanes >> 48);
+    }
+    for (; i < length; ++i)
+    {
+        sum += data[i];
+    }
+    return static_cast<std::uint8_t>(0x100 - (sum & 0xFF));
+}
 
-    for (std::size_t i = 0; i < data.size(); ++i)
+FrameTiming calcFrameTiming(const std::uint32_t baudrate, const int bits_per_char)
+{
+    using namespace std::chrono;
+    // fixed values recommended by Modbus over serial line specification
+    const microseconds high_speed_t15 = microseconds(750);
+    const microseconds high_speed_t35 = microseconds(1750);
+    const std::uint32_t high_speed_baudrate = 19200;
+    FrameTiming timing;
+    if (baudrate == 0)
+    {
+        return timing;
+    }
+    timing.char_time = microseconds((static_cast<std::uint64_t>(bits_per_char) * 1000000 + baudrate - 1) / baudrate);
+    if (baudrate > high_speed_baudrate)
     {
-        result = ibm_byte(result, data[i]);
+        timing.t15 = high_speed_t15;
+        timing.t35 = high_speed_t35;
     }
-    return result;
+    else
+    {
+        timing.t15 = (timing.char_time * 3 + microseconds(1)) / 2;
+        timing.t35 = (timing.char_time * 7 + microseconds(1)) / 2;
+    }
+    return timing;
+}
+
+std::vector<std::uint8_t>& ModbusClient::frameToBuffer()
+{
+    buffer.assign(frame.begin(), frame.end());
+    return buffer;
 }
 
 } // namespace modbus
@@ -0,0 +1,128 @@
+/**
+ * @file sm_crc_test.cpp
+ *
+ * @brief crc16 engines checked against bitwise reference implementation
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include "../inc/sm_crc.hpp"
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+///////////////////////////////////TEST CONSTANTS///////////////////////////////
+constexpr size_t max_length = 1100; // several clmul folding blocks
+constexpr size_t max_offset = 16;   // every alignment of 128-bit loads
+constexpr int random_splits = 20000;
+////////////////////////////////////////////////////////////////////////////////
+
+int failures = 0;
+
+void check(const bool condition, const char* what, const size_t length, const size_t offset)
+{
+    if (!condition)
+    {
+        if (failures < 10)
+        {
+            std::printf("FAILED: %s, length %zu, offset %zu\n", what, length, offset);
+        }
+        ++failures;
+    }
+}
+
+const char* getName(const modbus::CrcEngine engine)
+{
+    switch (engine)
+    {
+        case modbus::CrcEngine::bitwise:
+            return "bitwise";
+        case modbus::CrcEngine::table:
+            return "table";
+        case modbus::CrcEngine::slicing_by_8:
+            return "slicing_by_8";
+        case modbus::CrcEngine::clmul:
+            return "clmul";
+    }
+    return "unknown";
+}
+
+/// @brief every length and alignment, one call and two chained calls
+void testEngine(const modbus::CrcEngine engine, const std::vector<std::uint8_t>& data)
+{
+    for (size_t offset = 0; offset < max_offset; ++offset)
+    {
+        for (size_t length = 0; length <= max_length; ++length)
+        {
+            const std::uint8_t* block = data.data() + offset;
+            const std::uint16_t reference = modbus::crc16(modbus::CrcEngine::bitwise, block, length);
+            check(modbus::crc16(engine, block, length) == reference, getName(engine), length, offset);
+            const size_t split = length / 3;
+            const std::uint16_t first = modbus::crc16(engine, block, split);
+            check(modbus::crc16(engine, block + split, length - split, first) == reference, "chained call", length, offset);
+        }
+    }
+}
+
+/// @brief crc of changed or concatenated data derived without reading it
+void testDerived(const std::vector<std::uint8_t>& source, std::mt19937& random)
+{
+    for (int i = 0; i < random_splits; ++i)
+    {
+        const size_t length = 1 + random() % max_length;
+        std::vector<std::uint8_t> data(source.begin(), source.begin() + length);
+        const std::uint16_t crc = modbus::crc16(data.data(), length);
+
+        const size_t split = random() % (length + 1);
+        const std::uint16_t crc_a = modbus::crc16(data.data(), split);
+        const std::uint16_t crc_b = modbus::crc16(data.data() + split, length - split);
+        check(modbus::crc16Combine(crc_a, crc_b, length - split) == crc, "crc16Combine", length, split);
+
+        std::vector<std::uint8_t> padded(data);
+        padded.resize(length + split, 0);
+        check(modbus::crc16Shift(crc, split) == modbus::crc16(padded.data(), padded.size()), "crc16Shift", length, split);
+
+        const size_t position = random() % length;
+        const std::uint8_t old_value = data[position];
+        data[position] = static_cast<std::uint8_t>(random());
+        check(modbus::crc16Patch(crc, length, position, old_value, data[position]) == modbus::crc16(data.data(), length), "crc16Patch", length,
+              position);
+    }
+}
+} // namespace
+
+int main()
+{
+    std::mt19937 random(1);
+    std::vector<std::uint8_t> data(max_length + max_offset);
+    for (auto& value : data)
+    {
+        value = static_cast<std::uint8_t>(random());
+    }
+
+    // read holding registers request from Modbus specification, crc is sent low byte first
+    const std::uint8_t request[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x0A};
+    check(modbus::crc16(modbus::CrcEngine::bitwise, request, sizeof(request)) == 0xCDC5, "known value", sizeof(request), 0);
+
+    for (const auto engine : {modbus::CrcEngine::table, modbus::CrcEngine::slicing_by_8, modbus::CrcEngine::clmul})
+    {
+        if (!modbus::isCrcEngineSupported(engine))
+        {
+            std::printf("%s is not supported, skipped\n", getName(engine));
+            continue;
+        }
+        testEngine(engine, data);
+        // default engine is used by calls without explicit engine
+        modbus::setCrcEngine(engine);
+        check(modbus::getCrcEngine() == engine, "setCrcEngine", 0, 0);
+        check(modbus::crc16(data.data() + 1, max_length) == modbus::crc16(modbus::CrcEngine::bitwise, data.data() + 1, max_length), "default engine",
+              max_length, 1);
+    }
+    testDerived(data, random);
+
+    std::printf("%s, %d failures\n", (failures == 0) ? "passed" : "FAILED", failures);
+    return (failures == 0) ? 0 : 1;
+}
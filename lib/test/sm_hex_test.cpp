@@ -0,0 +1,186 @@
+/**
+ * @file sm_hex_test.cpp
+ *
+ * @brief hex engines of Modbus ASCII checked against scalar implementation,
+ * LRC checked against plain sum of bytes
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include "../inc/sm_hex.hpp"
+#include "../inc/sm_modbus.hpp"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+///////////////////////////////////TEST CONSTANTS///////////////////////////////
+constexpr size_t max_length = 3000;     // longer than any ASCII frame
+constexpr size_t max_offset = 32;       // every alignment of 256-bit loads
+constexpr size_t short_length = 100;    // every length up to it, tails of all sizes
+constexpr size_t char_test_length = 40; // vector blocks and scalar tail
+constexpr int random_lengths = 5000;
+constexpr std::uint8_t guard_value = 0xA5;
+////////////////////////////////////////////////////////////////////////////////
+
+int failures = 0;
+
+void check(const bool condition, const char* what, const size_t length, const size_t offset)
+{
+    if (!condition)
+    {
+        if (failures < 10)
+        {
+            std::printf("FAILED: %s, length %zu, offset %zu\n", what, length, offset);
+        }
+        ++failures;
+    }
+}
+
+const char* getName(const modbus::HexEngine engine)
+{
+    switch (engine)
+    {
+        case modbus::HexEngine::scalar:
+            return "scalar";
+        case modbus::HexEngine::sse2:
+            return "sse2";
+        case modbus::HexEngine::avx2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+bool isHexDigit(const std::uint8_t c) { return ((c >= '0') && (c <= '9')) || ((c >= 'A') && (c <= 'F')) || ((c >= 'a') && (c <= 'f')); }
+
+std::uint8_t toLower(const std::uint8_t c) { return ((c >= 'A') && (c <= 'F')) ? static_cast<std::uint8_t>(c + ('a' - 'A')) : c; }
+
+/// @brief encode and decode of one block, nothing is written past the output
+void testBlock(const modbus::HexEngine engine, const std::uint8_t* data, const size_t length, const size_t offset, std::mt19937& random)
+{
+    std::vector<std::uint8_t> reference(2 * length);
+    modbus::hexEncode(modbus::HexEngine::scalar, data, length, reference.data());
+
+    std::vector<std::uint8_t> hex(offset + 2 * length + 1, guard_value);
+    modbus::hexEncode(engine, data, length, hex.data() + offset);
+    check(std::memcmp(hex.data() + offset, reference.data(), reference.size()) == 0, "encode", length, offset);
+    check(hex[offset + 2 * length] == guard_value, "encode overrun", length, offset);
+
+    std::vector<std::uint8_t> decoded(offset + length + 1, guard_value);
+    check(modbus::hexDecode(engine, hex.data() + offset, length, decoded.data() + offset), "decode", length, offset);
+    check(std::memcmp(decoded.data() + offset, data, length) == 0, "decoded data", length, offset);
+    check(decoded[offset + length] == guard_value, "decode overrun", length, offset);
+
+    // lower and upper case are mixed in one frame
+    for (size_t i = 0; i < 2 * length; ++i)
+    {
+        hex[offset + i] = (random() & 1) ? toLower(hex[offset + i]) : hex[offset + i];
+    }
+    std::fill(decoded.begin(), decoded.end(), guard_value);
+    check(modbus::hexDecode(engine, hex.data() + offset, length, decoded.data() + offset), "decode mixed case", length, offset);
+    check(std::memcmp(decoded.data() + offset, data, length) == 0, "decoded mixed case", length, offset);
+}
+
+/// @brief every length up to short_length at every alignment, random lengths up to max_length
+void testEngine(const modbus::HexEngine engine, const std::vector<std::uint8_t>& data, std::mt19937& random)
+{
+    for (size_t offset = 0; offset < max_offset; ++offset)
+    {
+        for (size_t length = 0; length <= short_length; ++length)
+        {
+            testBlock(engine, data.data() + offset, length, offset, random);
+        }
+    }
+    for (int i = 0; i < random_lengths; ++i)
+    {
+        const size_t offset = random() % max_offset;
+        testBlock(engine, data.data() + offset, random() % (max_length + 1), offset, random);
+    }
+}
+
+/// @brief each of 256 characters at each position, only hex digits are accepted
+void testCharacters(const modbus::HexEngine engine)
+{
+    std::vector<std::uint8_t> data(char_test_length);
+    std::vector<std::uint8_t> hex(2 * char_test_length, '0');
+    for (int value = 0; value <= 0xFF; ++value)
+    {
+        const std::uint8_t c = static_cast<std::uint8_t>(value);
+        for (size_t position = 0; position < hex.size(); ++position)
+        {
+            hex[position] = c;
+            const bool decoded = modbus::hexDecode(engine, hex.data(), char_test_length, data.data());
+            check(decoded == isHexDigit(c), getName(engine), value, position);
+            if (decoded)
+            {
+                const std::uint8_t nibble = (c <= '9') ? (c - '0') : ((toLower(c) - 'a') + 10);
+                const std::uint8_t expected = (position % 2) ? nibble : static_cast<std::uint8_t>(nibble << 4);
+                check(data[position / 2] == expected, "decoded character", value, position);
+            }
+            hex[position] = '0';
+        }
+    }
+}
+
+/// @brief lane-wise sum against plain sum at every length and alignment
+void testLrc(const std::vector<std::uint8_t>& data)
+{
+    const std::vector<std::uint8_t> blank(max_length, 0xFF);
+    for (size_t offset = 0; offset < max_offset; offset += 7)
+    {
+        for (size_t length = 0; length <= max_length; ++length)
+        {
+            std::uint8_t sum = 0;
+            for (size_t i = 0; i < length; ++i)
+            {
+                sum = static_cast<std::uint8_t>(sum + data[offset + i]);
+            }
+            check(modbus::calcLrc(data.data() + offset, length) == static_cast<std::uint8_t>(-sum), "calcLrc", length, offset);
+        }
+    }
+    for (size_t length = 0; length <= max_length; ++length)
+    {
+        check(modbus::calcLrc(blank.data(), length) == static_cast<std::uint8_t>(length), "calcLrc of blank data", length, 0);
+    }
+}
+} // namespace
+
+int main()
+{
+    std::mt19937 random(1);
+    std::vector<std::uint8_t> data(max_length + max_offset);
+    for (auto& value : data)
+    {
+        value = static_cast<std::uint8_t>(random());
+    }
+
+    const std::uint8_t bytes[] = {0x01, 0x3A, 0xBF, 0x00};
+    std::uint8_t hex[2 * sizeof(bytes)] = {};
+    modbus::hexEncode(modbus::HexEngine::scalar, bytes, sizeof(bytes), hex);
+    check(std::memcmp(hex, "013ABF00", sizeof(hex)) == 0, "known value", sizeof(bytes), 0);
+
+    for (const auto engine : {modbus::HexEngine::scalar, modbus::HexEngine::sse2, modbus::HexEngine::avx2})
+    {
+        if (!modbus::isHexEngineSupported(engine))
+        {
+            std::printf("%s is not supported, skipped\n", getName(engine));
+            continue;
+        }
+        testEngine(engine, data, random);
+        testCharacters(engine);
+        // default engine is used by calls without explicit engine
+        check(modbus::setHexEngine(engine) && (modbus::getHexEngine() == engine), "setHexEngine", 0, 0);
+        std::vector<std::uint8_t> encoded(2 * max_length);
+        std::vector<std::uint8_t> reference(2 * max_length);
+        modbus::hexEncode(data.data() + 1, max_length, encoded.data());
+        modbus::hexEncode(modbus::HexEngine::scalar, data.data() + 1, max_length, reference.data());
+        check(encoded == reference, "default engine", max_length, 1);
+    }
+    testLrc(data);
+
+    std::printf("%s, %d failures\n", (failures == 0) ? "passed" : "FAILED", failures);
+    return (failures == 0) ? 0 : 1;
+}
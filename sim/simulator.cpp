@@ -0,0 +1,559 @@
+/**
+ * @file simulator.cpp
+ *
+ * @brief Modbus bootloader simulator on a pseudo-terminal, used to test and
+ * benchmark sm::Client without real boards
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fcntl.h>
+#include <fstream>
+#include <poll.h>
+#include <random>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+
+#include "../inc/sm_modbus.hpp"
+#include "sm_server.hpp"
+
+namespace
+{
+//////////////////////////////SIMULATOR CONSTANTS///////////////////////////////
+// partial frame is dropped after this silence, the same way t3.5 does on the line
+constexpr std::chrono::milliseconds frame_drop_timeout{100};
+// response is written to the line by chunks of this size when pacing is enabled
+constexpr size_t pacing_chunk_size = 16;
+constexpr size_t read_chunk_size = 4096;
+constexpr std::uint32_t default_baudrate = 0;
+////////////////////////////////////////////////////////////////////////////////
+
+struct SimulatorConfig
+{
+    sim::ServerConfig gateway;
+    std::uint8_t downstream_addr = 2;
+    /// @brief servers on the client line next to the gateway, addresses
+    /// follow gateway and downstream ones
+    int peers = 0;
+    modbus::ModbusMode mode = modbus::ModbusMode::rtu;
+    bool rtu_padding = true;
+    /// @brief baudrate used to pace the line, 0 to disable pacing
+    std::uint32_t baudrate = default_baudrate;
+    /// @brief server processing time per request
+    std::chrono::microseconds latency{0};
+    /// @brief probability of response drop in %
+    double drop_rate = 0.0;
+    /// @brief probability of broadcast request missed by a server in %
+    double miss_rate = 0.0;
+    /// @brief probability of response crc corruption in %
+    double corrupt_rate = 0.0;
+    unsigned int seed = 1;
+    /// @brief prefix for application images saved on exit, empty to skip
+    std::string dump_prefix;
+    bool verbose = false;
+};
+
+struct Statistics
+{
+    size_t requests = 0;
+    size_t responses = 0;
+    size_t forwarded = 0;
+    size_t broadcasts = 0;
+    size_t bytes_received = 0;
+    size_t bytes_sent = 0;
+    size_t bad_crc = 0;
+    size_t broken_frames = 0;
+    size_t dropped = 0;
+    size_t missed = 0;
+    size_t corrupted = 0;
+    size_t ignored = 0;
+};
+
+std::atomic<bool> stop_request{false};
+std::atomic<bool> statistics_request{false};
+
+void onSignal(int) { stop_request.store(true); }
+void onStatisticsSignal(int) { statistics_request.store(true); }
+
+void printUsage(const char* name)
+{
+    std::printf("usage: %s [options]\n\n"
+                "  -a addr    gateway server address, default 1\n"
+                "  -d addr    server address behind the gateway, 0 to disable, default 2\n"
+                "  -p count   servers on the client line next to the gateway, default 0\n"
+                "  -r size    record size in bytes, default 64\n"
+                "  -f kib     available flash in KiB, default 256\n"
+                "  -m mode    rtu or ascii, default rtu\n"
+                "  -n         no zero padding around RTU frames, needed for broadcast\n"
+                "  -b baud    pace the line as with this baudrate, default no pacing\n"
+                "  -l us      server processing latency in microseconds, default 0\n"
+                "  -e %%       probability of dropped response, default 0\n"
+                "  -x %%       probability of broadcast missed by every server, default 0\n"
+                "  -c %%       probability of response with bad crc, default 0\n"
+                "  -s seed    seed for error injection, default 1\n"
+                "  -o prefix  save application images to <prefix><addr>.bin on exit\n"
+                "  -v         print every request\n\n"
+                "statistics are printed on exit and on SIGUSR1\n",
+                name);
+}
+
+bool parseArguments(int argc, char* argv[], SimulatorConfig& config)
+{
+    int option = 0;
+    while ((option = getopt(argc, argv, "a:d:p:r:f:m:nb:l:e:x:c:s:o:vh")) != -1)
+    {
+        switch (option)
+        {
+            case 'a':
+                config.gateway.addr = static_cast<std::uint8_t>(std::atoi(optarg));
+                break;
+            case 'd':
+                config.downstream_addr = static_cast<std::uint8_t>(std::atoi(optarg));
+                break;
+            case 'p':
+                config.peers = std::atoi(optarg);
+                break;
+            case 'r':
+                config.gateway.record_size = static_cast<std::uint16_t>(std::atoi(optarg));
+                break;
+            case 'f':
+                config.gateway.available_rom = static_cast<std::uint32_t>(std::atol(optarg)) * 1024U;
+                break;
+            case 'm':
+                config.mode = (std::string(optarg) == "ascii") ? modbus::ModbusMode::ascii : modbus::ModbusMode::rtu;
+                config.gateway.mode = config.mode;
+                break;
+            case 'n':
+                config.rtu_padding = false;
+                break;
+            case 'b':
+                config.baudrate = static_cast<std::uint32_t>(std::atol(optarg));
+                break;
+            case 'l':
+                config.latency = std::chrono::microseconds(std::atol(optarg));
+                break;
+            case 'e':
+                config.drop_rate = std::atof(optarg);
+                break;
+            case 'x':
+                config.miss_rate = std::atof(optarg);
+                break;
+            case 'c':
+                config.corrupt_rate = std::atof(optarg);
+                break;
+            case 's':
+                config.seed = static_cast<unsigned int>(std::atol(optarg));
+                break;
+            case 'o':
+                config.dump_prefix = optarg;
+                break;
+            case 'v':
+                config.verbose = true;
+                break;
+            default:
+                return false;
+        }
+    }
+    // record with write file header must fit into one PDU, client keeps record size in one byte
+    const std::uint16_t max_record_size = modbus::max_pdu_size - 2 - modbus::file_sub_request_size;
+    if ((config.gateway.addr == 0) || (config.gateway.addr == config.downstream_addr) || (config.peers < 0) ||
+        ((std::max(config.gateway.addr, config.downstream_addr) + config.peers) > 247) || (config.gateway.record_size == 0) ||
+        (config.gateway.record_size > max_record_size) || ((config.gateway.record_size % 2) != 0))
+    {
+        std::printf("invalid server address or record size (even, up to %d bytes)\n", max_record_size);
+        return false;
+    }
+    return true;
+}
+
+/// @brief open pty pair with raw slave, slave stays opened to keep the pair alive between client sessions
+int openPty(int& slave_desc, std::string& slave_name)
+{
+    int master_desc = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((master_desc < 0) || (grantpt(master_desc) != 0) || (unlockpt(master_desc) != 0))
+    {
+        return -1;
+    }
+    slave_name = ptsname(master_desc);
+    slave_desc = open(slave_name.c_str(), O_RDWR | O_NOCTTY);
+    if (slave_desc < 0)
+    {
+        return -1;
+    }
+    struct termios tty = {};
+    tcgetattr(slave_desc, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(slave_desc, TCSANOW, &tty);
+    return master_desc;
+}
+
+class Simulator
+{
+public:
+    explicit Simulator(const SimulatorConfig& config)
+        : config(config), gateway(config.gateway), downstream(downstreamConfig(config)), random(config.seed)
+    {
+        sim::ServerConfig peer = config.gateway;
+        for (int i = 1; i <= config.peers; ++i)
+        {
+            peer.addr = static_cast<std::uint8_t>(std::max(config.gateway.addr, config.downstream_addr) + i);
+            peers.emplace_back(peer);
+        }
+        encoder.setMode(config.mode);
+        encoder.setRtuPadding(config.rtu_padding);
+        parser.reset(config.mode, config.rtu_padding, modbus::FrameDirection::request);
+        // 8N1 characters
+        const int bits_per_char = 10;
+        char_time = modbus::calcFrameTiming(config.baudrate, bits_per_char).char_time;
+    }
+
+    void run(const int desc)
+    {
+        std::uint8_t chunk[read_chunk_size];
+        struct pollfd poll_desc = {};
+        poll_desc.fd = desc;
+        poll_desc.events = POLLIN;
+        auto last_byte_time = std::chrono::steady_clock::now();
+        // signals are delivered inside ppoll only, a flag set by them is never
+        // missed by an infinite wait
+        sigset_t blocked_mask;
+        sigset_t poll_mask;
+        sigemptyset(&blocked_mask);
+        sigaddset(&blocked_mask, SIGINT);
+        sigaddset(&blocked_mask, SIGTERM);
+        sigaddset(&blocked_mask, SIGUSR1);
+        sigprocmask(SIG_BLOCK, &blocked_mask, &poll_mask);
+        while (!stop_request.load())
+        {
+            if (statistics_request.exchange(false))
+            {
+                printStatistics();
+                std::fflush(stdout);
+            }
+            writeScheduled(desc);
+            // wake up for the next scheduled response chunk or to drop partial frame
+            const auto now = std::chrono::steady_clock::now();
+            auto wakeup = std::chrono::steady_clock::time_point::max();
+            if (!parser.empty())
+            {
+                wakeup = last_byte_time + frame_drop_timeout;
+            }
+            if (!output.empty())
+            {
+                wakeup = std::min(wakeup, output.front().due);
+            }
+            struct timespec timeout = {};
+            if (wakeup != std::chrono::steady_clock::time_point::max())
+            {
+                const auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(std::max(wakeup - now, std::chrono::steady_clock::duration::zero()));
+                timeout.tv_sec = static_cast<time_t>(wait.count() / 1000000000);
+                timeout.tv_nsec = static_cast<long>(wait.count() % 1000000000);
+            }
+            const int n = ppoll(&poll_desc, 1, (wakeup != std::chrono::steady_clock::time_point::max()) ? &timeout : nullptr, &poll_mask);
+            if (n == 0)
+            {
+                if (!parser.empty() && (std::chrono::steady_clock::now() >= (last_byte_time + frame_drop_timeout)))
+                {
+                    ++stats.broken_frames;
+                    parser.reset();
+                }
+                continue;
+            }
+            if (n < 0)
+            {
+                continue; // interrupted by signal
+            }
+            const ssize_t bytes_read = read(desc, chunk, sizeof(chunk));
+            if (bytes_read <= 0)
+            {
+                continue;
+            }
+            last_byte_time = std::chrono::steady_clock::now();
+            stats.bytes_received += bytes_read;
+            size_t offset = 0;
+            while (offset < static_cast<size_t>(bytes_read))
+            {
+                const bool frame_started = !parser.empty();
+                offset += parser.push(chunk + offset, bytes_read - offset);
+                // padding of the previous frame does not start the next one
+                if (!frame_started && !parser.empty())
+                {
+                    frame_start = last_byte_time;
+                }
+                if (parser.getStatus() != modbus::ParserStatus::incomplete)
+                {
+                    handleFrame();
+                    parser.reset();
+                }
+            }
+        }
+        sigprocmask(SIG_SETMASK, &poll_mask, nullptr);
+    }
+
+    void printStatistics() const
+    {
+        std::printf("\nrequests      : %zu\n"
+                    "responses     : %zu\n"
+                    "forwarded     : %zu\n"
+                    "broadcasts    : %zu\n"
+                    "bytes in/out  : %zu / %zu\n"
+                    "bad crc       : %zu\n"
+                    "broken frames : %zu\n"
+                    "not for us    : %zu\n"
+                    "dropped       : %zu (injected)\n"
+                    "missed        : %zu (injected)\n"
+                    "corrupted     : %zu (injected)\n",
+                    stats.requests, stats.responses, stats.forwarded, stats.broadcasts, stats.bytes_received, stats.bytes_sent, stats.bad_crc,
+                    stats.broken_frames, stats.ignored, stats.dropped, stats.missed, stats.corrupted);
+    }
+
+    void saveApplications(const std::string& prefix) const
+    {
+        std::vector<const sim::Server*> servers = {&gateway};
+        if (config.downstream_addr != 0)
+        {
+            servers.push_back(&downstream);
+        }
+        for (const sim::Server& peer : peers)
+        {
+            servers.push_back(&peer);
+        }
+        for (const sim::Server* server : servers)
+        {
+            const std::string path = prefix + std::to_string(server->getAddress()) + ".bin";
+            const std::vector<std::uint8_t> image = server->getApplication();
+            std::ofstream out(path, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(image.data()), image.size());
+            std::printf("server %d: %zu bytes of application saved to %s\n", server->getAddress(), image.size(), path.c_str());
+        }
+    }
+
+private:
+    SimulatorConfig config;
+    sim::Server gateway;
+    sim::Server downstream;
+    std::vector<sim::Server> peers;
+    modbus::FrameParser parser;
+    modbus::ModbusClient encoder;
+    modbus::Frame response;
+    std::vector<std::uint8_t> pdu;
+    std::chrono::microseconds char_time{0};
+    std::chrono::steady_clock::time_point frame_start;
+    /// @brief time points when the line to the client and the line to the
+    /// downstream server are free, lines are full-duplex, so the gateway
+    /// receives next request while it relays the previous one
+    std::chrono::steady_clock::time_point request_line_free;
+    std::chrono::steady_clock::time_point response_line_free;
+    std::chrono::steady_clock::time_point downstream_line_free;
+    /// @brief response chunks waiting for their time on the line
+    struct Output
+    {
+        std::chrono::steady_clock::time_point due;
+        std::vector<std::uint8_t> data;
+        bool last = false;
+    };
+    std::deque<Output> output;
+    std::mt19937 random;
+    Statistics stats;
+
+    static sim::ServerConfig downstreamConfig(const SimulatorConfig& config)
+    {
+        sim::ServerConfig server = config.gateway;
+        server.addr = config.downstream_addr;
+        return server;
+    }
+
+    bool inject(const double rate)
+    {
+        return (rate > 0.0) && (std::uniform_real_distribution<double>(0.0, 100.0)(random) < rate);
+    }
+
+    std::chrono::microseconds wireTime(const size_t length) const { return char_time * static_cast<int>(length); }
+
+    void handleFrame()
+    {
+        if (parser.getStatus() == modbus::ParserStatus::error)
+        {
+            ++stats.broken_frames;
+            return;
+        }
+        if (!parser.isChecksumValid())
+        {
+            ++stats.bad_crc; // real server keeps silence
+            return;
+        }
+        ++stats.requests;
+        const std::uint8_t addr = parser.data()[0];
+        const std::uint8_t function = parser.data()[modbus::address_size];
+        if (config.verbose)
+        {
+            std::printf("request to %d, function 0x%02x, %zu bytes\n", addr, function, parser.getAduSize());
+        }
+        // request takes its wire time to arrive, then server needs some time to process it,
+        // requests sent back to back arrive one after another
+        const auto request_end = std::max(frame_start, request_line_free) + wireTime(parser.getAduSize());
+        request_line_free = request_end;
+        auto response_time = request_end + config.latency;
+        auto peer = std::find_if(peers.begin(), peers.end(), [addr](const sim::Server& server) { return server.getAddress() == addr; });
+        if (addr == modbus::broadcast_address)
+        {
+            // every server on the client line handles it silently, gateway does not forward it
+            ++stats.broadcasts;
+            std::vector<sim::Server*> servers = {&gateway};
+            for (sim::Server& server : peers)
+            {
+                servers.push_back(&server);
+            }
+            for (sim::Server* server : servers)
+            {
+                if (inject(config.miss_rate))
+                {
+                    ++stats.missed;
+                    continue;
+                }
+                server->handleRequest(parser.data(), parser.size(), pdu);
+            }
+            return;
+        }
+        else if (addr == gateway.getAddress())
+        {
+            gateway.handleRequest(parser.data(), parser.size(), pdu);
+            encode(addr);
+        }
+        else if (peer != peers.end())
+        {
+            peer->handleRequest(parser.data(), parser.size(), pdu);
+            encode(addr);
+        }
+        else if ((config.downstream_addr != 0) && (addr == downstream.getAddress()))
+        {
+            downstream.handleRequest(parser.data(), parser.size(), pdu);
+            encode(addr);
+            if (!gateway.passForwarded(parser.data(), response.size()))
+            {
+                pdu.assign({static_cast<std::uint8_t>(function | 0x80), sim::gateway_target_failed});
+                encode(addr);
+            }
+            // request and response are passed over the second line as well, one at a time
+            response_time = std::max(response_time, downstream_line_free) + wireTime(parser.getAduSize()) + config.latency +
+                            wireTime(response.size());
+            downstream_line_free = response_time;
+            ++stats.forwarded;
+        }
+        else
+        {
+            ++stats.ignored;
+            return;
+        }
+        if (inject(config.drop_rate))
+        {
+            ++stats.dropped;
+            return;
+        }
+        if (inject(config.corrupt_rate))
+        {
+            ++stats.corrupted;
+            size_t crc_position = response.size() - 1;
+            crc_position -= (config.mode == modbus::ModbusMode::ascii) ? modbus::ascii_stop_size : 0;
+            crc_position -= ((config.mode == modbus::ModbusMode::rtu) && config.rtu_padding) ? modbus::rtu_stop_size : 0;
+            response[crc_position] ^= 0x01;
+        }
+        schedule(response_time);
+    }
+
+    void encode(const std::uint8_t addr)
+    {
+        const std::uint8_t* data = pdu.data() + modbus::function_size;
+        encoder.encodeCustom(response, addr, pdu[0], data, pdu.size() - modbus::function_size);
+    }
+
+    /// @brief split response into chunks paced as on the line, responses
+    /// follow each other on the line to the client
+    void schedule(const std::chrono::steady_clock::time_point ready)
+    {
+        auto due = std::max(ready, response_line_free);
+        size_t offset = 0;
+        while (offset < response.size())
+        {
+            const size_t length = (char_time.count() == 0) ? (response.size() - offset) : std::min(pacing_chunk_size, response.size() - offset);
+            Output chunk;
+            chunk.due = due;
+            chunk.data.assign(response.data() + offset, response.data() + offset + length);
+            offset += length;
+            chunk.last = (offset == response.size());
+            output.push_back(std::move(chunk));
+            due += wireTime(length);
+        }
+        response_line_free = due;
+    }
+
+    void writeScheduled(const int desc)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        while (!output.empty() && (output.front().due <= now))
+        {
+            Output& chunk = output.front();
+            const ssize_t n = ::write(desc, chunk.data.data(), chunk.data.size());
+            if (n <= 0)
+            {
+                return;
+            }
+            stats.bytes_sent += n;
+            if (static_cast<size_t>(n) < chunk.data.size())
+            {
+                chunk.data.erase(chunk.data.begin(), chunk.data.begin() + n);
+                return;
+            }
+            stats.responses += chunk.last ? 1 : 0;
+            output.pop_front();
+        }
+    }
+};
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    SimulatorConfig config;
+    if (!parseArguments(argc, argv, config))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    int slave_desc = -1;
+    std::string slave_name;
+    const int master_desc = openPty(slave_desc, slave_name);
+    if (master_desc < 0)
+    {
+        std::perror("failed to open pty");
+        return EXIT_FAILURE;
+    }
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    std::signal(SIGUSR1, onStatisticsSignal);
+
+    // client adds /dev/ prefix itself
+    std::printf("%s\n", slave_name.substr(std::string("/dev/").size()).c_str());
+    std::printf("gateway address %d, downstream address %d, %d peers, record size %d bytes\n", config.gateway.addr, config.downstream_addr,
+                config.peers, config.gateway.record_size);
+    std::fflush(stdout);
+
+    Simulator simulator(config);
+    simulator.run(master_desc);
+    simulator.printStatistics();
+    if (!config.dump_prefix.empty())
+    {
+        simulator.saveApplications(config.dump_prefix);
+    }
+    close(slave_desc);
+    close(master_desc);
+    return EXIT_SUCCESS;
+}
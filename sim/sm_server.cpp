@@ -0,0 +1,384 @@
+/**
+ * @file sm_server.cpp
+ *
+ * @brief implementation for class defined in sm_server.hpp
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include "sm_server.hpp"
+#include "../inc/sm_crc.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace sim;
+
+namespace
+{
+std::uint16_t getHalfWord(const std::uint8_t* data) { return static_cast<std::uint16_t>((data[0] << 8) | data[1]); }
+
+void putHalfWord(std::vector<std::uint8_t>& pdu, const std::uint16_t value)
+{
+    pdu.push_back(static_cast<std::uint8_t>(value >> 8));
+    pdu.push_back(static_cast<std::uint8_t>(value & 0xFF));
+}
+} // namespace
+
+Server::Server(const ServerConfig& config)
+    : addr(config.addr), checksum_size(modbus::getChecksumSize(config.mode)), application(config.available_rom, 0xFF)
+{
+    regs[static_cast<int>(sm::ServerRegisters::record_size)] = config.record_size;
+    regs[static_cast<int>(sm::ServerRegisters::boot_status)] = static_cast<std::uint16_t>(sm::BootloaderStatus::empty);
+
+    sm::BootloaderInfo info = {};
+    std::strncpy(info.boot_version, config.boot_version.c_str(), sizeof(info.boot_version) - 1);
+    std::strncpy(info.boot_name, config.boot_name.c_str(), sizeof(info.boot_name) - 1);
+    info.available_rom = config.available_rom;
+    const std::uint8_t* raw = reinterpret_cast<const std::uint8_t*>(&info);
+    metadata.assign(raw, raw + sizeof(info));
+}
+
+std::vector<std::uint8_t> Server::getApplication() const
+{
+    const size_t app_size = getAppSize() * getRegister(sm::ServerRegisters::record_size);
+    return std::vector<std::uint8_t>(application.begin(), application.begin() + std::min(app_size, application.size()));
+}
+
+void Server::handleRequest(const std::uint8_t* request, const size_t length, std::vector<std::uint8_t>& pdu)
+{
+    const size_t header_size = modbus::address_size + modbus::function_size;
+    const std::uint8_t function = request[modbus::address_size];
+    const std::uint8_t* data = request + header_size;
+    const size_t data_size = length - header_size - checksum_size;
+    pdu.clear();
+    switch (static_cast<modbus::FunctionCodes>(function))
+    {
+        case modbus::FunctionCodes::read_registers:
+            readRegisters(data, pdu);
+            break;
+
+        case modbus::FunctionCodes::write_register:
+            writeRegister(data, pdu);
+            break;
+
+        case modbus::FunctionCodes::write_registers:
+            writeRegisters(data, data_size, pdu);
+            break;
+
+        case modbus::FunctionCodes::read_file:
+            readFile(data, data_size, pdu);
+            break;
+
+        case modbus::FunctionCodes::write_file:
+            writeFile(data, data_size, pdu);
+            break;
+
+        default:
+            // ping is answered this way too, client expects exception
+            exception(function, illegal_function, pdu);
+            break;
+    }
+}
+
+bool Server::passForwarded(const std::uint8_t* request, const size_t response_size)
+{
+    if (response_size > getRegister(sm::ServerRegisters::gateway_buffer_size))
+    {
+        return false;
+    }
+    const std::uint8_t function = request[modbus::address_size];
+    const std::uint8_t byte_count = request[modbus::address_size + modbus::function_size];
+    size_t num_of_records = 0;
+    if (function == static_cast<std::uint8_t>(modbus::FunctionCodes::read_file))
+    {
+        num_of_records = byte_count / modbus::file_sub_request_size;
+    }
+    else if (function == static_cast<std::uint8_t>(modbus::FunctionCodes::write_file))
+    {
+        // sub-requests carry record data, walk through them
+        const std::uint8_t* sub_request = request + modbus::address_size + modbus::function_size + 1;
+        const std::uint8_t* end = sub_request + byte_count;
+        while (sub_request < end)
+        {
+            sub_request += modbus::file_sub_request_size + getHalfWord(sub_request + 5) * 2;
+            ++num_of_records;
+        }
+    }
+    std::uint16_t& counter = regs[static_cast<int>(sm::ServerRegisters::record_counter)];
+    std::uint16_t& file_control = regs[static_cast<int>(sm::ServerRegisters::gateway_file_control)];
+    if ((num_of_records != 0) && (file_control != 0) && (counter != 0))
+    {
+        // file transfer through the gateway is finished with the last record
+        counter = (counter > num_of_records) ? (counter - num_of_records) : 0;
+        if (counter == 0)
+        {
+            file_control = 0;
+        }
+    }
+    return true;
+}
+
+void Server::exception(const std::uint8_t function, const std::uint8_t code, std::vector<std::uint8_t>& pdu)
+{
+    pdu.clear();
+    pdu.push_back(function | 0x80);
+    pdu.push_back(code);
+}
+
+int Server::getRegisterIndex(const std::uint16_t reg)
+{
+    // client reads registers with holding registers offset, but writes them without it
+    const std::uint16_t index = (reg >= modbus::holding_regs_offset) ? (reg - modbus::holding_regs_offset) : reg;
+    return (index < (sm::amount_of_regs + sm::amount_of_ext_regs)) ? index : -1;
+}
+
+void Server::readRegisters(const std::uint8_t* data, std::vector<std::uint8_t>& pdu)
+{
+    const std::uint8_t function = static_cast<std::uint8_t>(modbus::FunctionCodes::read_registers);
+    const int start = getRegisterIndex(getHalfWord(data));
+    const std::uint16_t quantity = getHalfWord(data + 2);
+    if ((start < 0) || (quantity == 0) || ((start + quantity) > (sm::amount_of_regs + sm::amount_of_ext_regs)))
+    {
+        exception(function, illegal_data_address, pdu);
+        return;
+    }
+    pdu.push_back(function);
+    pdu.push_back(static_cast<std::uint8_t>(quantity * 2));
+    for (int i = start; i < (start + quantity); ++i)
+    {
+        putHalfWord(pdu, regs[i]);
+    }
+}
+
+bool Server::storeRegister(const std::uint8_t function, const int index, const std::uint16_t value, std::vector<std::uint8_t>& pdu)
+{
+    if ((index < 0) || (index == static_cast<int>(sm::ServerRegisters::record_size)) ||
+        (index == static_cast<int>(sm::ServerRegisters::boot_status)))
+    {
+        exception(function, illegal_data_address, pdu);
+        return false;
+    }
+    std::uint16_t& boot_status = regs[static_cast<int>(sm::ServerRegisters::boot_status)];
+    switch (static_cast<sm::ServerRegisters>(index))
+    {
+        case sm::ServerRegisters::app_size:
+            if ((static_cast<size_t>(value) * getRegister(sm::ServerRegisters::record_size)) > application.size())
+            {
+                exception(function, illegal_data_value, pdu);
+                return false;
+            }
+            regs[static_cast<int>(sm::ServerRegisters::app_size_high)] = 0;
+            break;
+
+        case sm::ServerRegisters::app_size_high:
+            if ((((static_cast<size_t>(value) << 16) | getRegister(sm::ServerRegisters::app_size)) * getRegister(sm::ServerRegisters::record_size)) >
+                application.size())
+            {
+                exception(function, illegal_data_value, pdu);
+                return false;
+            }
+            break;
+
+        case sm::ServerRegisters::file_control:
+            regs[static_cast<int>(sm::ServerRegisters::file_bank)] = 0;
+            break;
+
+        case sm::ServerRegisters::app_erase:
+            if (value == sm::app_erase_request)
+            {
+                std::fill(application.begin(), application.end(), 0xFF);
+                boot_status = static_cast<std::uint16_t>(sm::BootloaderStatus::empty);
+            }
+            break;
+
+        case sm::ServerRegisters::app_start:
+            if (value == sm::app_start_request)
+            {
+                if (boot_status != static_cast<std::uint16_t>(sm::BootloaderStatus::ready))
+                {
+                    exception(function, server_device_failure, pdu);
+                    return false;
+                }
+                std::printf("server %d: application started\n", addr);
+            }
+            break;
+
+        default:
+            break;
+    }
+    regs[index] = value;
+    return true;
+}
+
+void Server::writeRegister(const std::uint8_t* data, std::vector<std::uint8_t>& pdu)
+{
+    const std::uint8_t function = static_cast<std::uint8_t>(modbus::FunctionCodes::write_register);
+    if (!storeRegister(function, getRegisterIndex(getHalfWord(data)), getHalfWord(data + 2), pdu))
+    {
+        return;
+    }
+    // echo of register address and value
+    pdu.push_back(function);
+    pdu.insert(pdu.end(), data, data + 4);
+}
+
+void Server::writeRegisters(const std::uint8_t* data, const size_t length, std::vector<std::uint8_t>& pdu)
+{
+    const std::uint8_t function = static_cast<std::uint8_t>(modbus::FunctionCodes::write_registers);
+    const int start = getRegisterIndex(getHalfWord(data));
+    const std::uint16_t quantity = getHalfWord(data + 2);
+    const size_t byte_count = data[4];
+    if ((quantity == 0) || (quantity > modbus::max_write_registers) || (byte_count != (quantity * 2U)) || ((byte_count + 5) > length))
+    {
+        exception(function, illegal_data_value, pdu);
+        return;
+    }
+    if ((start < 0) || ((start + quantity) > (sm::amount_of_regs + sm::amount_of_ext_regs)))
+    {
+        exception(function, illegal_data_address, pdu);
+        return;
+    }
+    // registers are written in order, side effects of earlier ones are kept on failure
+    for (int i = 0; i < quantity; ++i)
+    {
+        if (!storeRegister(function, start + i, getHalfWord(data + 5 + i * 2), pdu))
+        {
+            return;
+        }
+    }
+    // echo of start address and quantity
+    pdu.push_back(function);
+    pdu.insert(pdu.end(), data, data + 4);
+}
+
+size_t Server::getAppSize() const
+{
+    return (static_cast<size_t>(getRegister(sm::ServerRegisters::app_size_high)) << 16) | getRegister(sm::ServerRegisters::app_size);
+}
+
+size_t Server::getRecordOffset(const std::uint16_t record_id, const size_t record_size) const
+{
+    return ((static_cast<size_t>(getRegister(sm::ServerRegisters::file_bank)) * modbus::max_num_of_records) + record_id) * record_size;
+}
+
+std::vector<std::uint8_t> Server::getRecordChecksums() const
+{
+    const size_t record_size = getRegister(sm::ServerRegisters::record_size);
+    const size_t app_size = std::min<size_t>(getAppSize(), application.size() / record_size);
+    std::vector<std::uint8_t> checksums;
+    checksums.reserve(app_size * 2);
+    for (size_t i = 0; i < app_size; ++i)
+    {
+        putHalfWord(checksums, modbus::crc16(&application[i * record_size], record_size));
+    }
+    return checksums;
+}
+
+void Server::readFile(const std::uint8_t* data, const size_t length, std::vector<std::uint8_t>& pdu)
+{
+    const std::uint8_t function = static_cast<std::uint8_t>(modbus::FunctionCodes::read_file);
+    const size_t byte_count = data[0];
+    if ((byte_count == 0) || ((byte_count % modbus::file_sub_request_size) != 0) || ((byte_count + 1) > length))
+    {
+        exception(function, illegal_data_value, pdu);
+        return;
+    }
+    pdu.push_back(function);
+    pdu.push_back(0); // response data length, set at the end
+    std::vector<std::uint8_t> checksums;
+    for (size_t offset = 1; offset < (byte_count + 1); offset += modbus::file_sub_request_size)
+    {
+        const std::uint8_t* sub_request = data + offset;
+        const std::uint16_t file_id = getHalfWord(sub_request + 1);
+        const std::uint16_t record_id = getHalfWord(sub_request + 3);
+        const size_t record_length = static_cast<size_t>(getHalfWord(sub_request + 5)) * 2;
+        const std::vector<std::uint8_t>* file = nullptr;
+        size_t record_size = getRegister(sm::ServerRegisters::record_size);
+        if (file_id == static_cast<std::uint16_t>(sm::ServerFiles::application))
+        {
+            file = &application;
+        }
+        else if (file_id == static_cast<std::uint16_t>(sm::ServerFiles::server_metadata))
+        {
+            file = &metadata;
+        }
+        else if (file_id == static_cast<std::uint16_t>(sm::ServerFiles::record_checksums))
+        {
+            if (checksums.empty())
+            {
+                checksums = getRecordChecksums();
+            }
+            file = &checksums;
+        }
+        const size_t start = getRecordOffset(record_id, record_size);
+        if ((sub_request[0] != modbus::file_reference_type) || (file == nullptr) || (start >= file->size()))
+        {
+            exception(function, illegal_data_address, pdu);
+            return;
+        }
+        if ((pdu.size() + record_length + 2) > modbus::max_pdu_size)
+        {
+            exception(function, illegal_data_value, pdu);
+            return;
+        }
+        pdu.push_back(static_cast<std::uint8_t>(record_length + 1));
+        pdu.push_back(modbus::file_reference_type);
+        // the last record of the file may be shorter, it is padded with zeros
+        const size_t available = std::min(record_length, file->size() - start);
+        pdu.insert(pdu.end(), file->begin() + start, file->begin() + start + available);
+        pdu.insert(pdu.end(), record_length - available, 0);
+    }
+    pdu[1] = static_cast<std::uint8_t>(pdu.size() - 2);
+}
+
+void Server::writeFile(const std::uint8_t* data, const size_t length, std::vector<std::uint8_t>& pdu)
+{
+    const std::uint8_t function = static_cast<std::uint8_t>(modbus::FunctionCodes::write_file);
+    const size_t byte_count = data[0];
+    if ((byte_count < modbus::file_sub_request_size) || ((byte_count + 1) > length))
+    {
+        exception(function, illegal_data_value, pdu);
+        return;
+    }
+    const size_t record_size = getRegister(sm::ServerRegisters::record_size);
+    const size_t app_size = getAppSize();
+    bool last_record = false;
+    size_t offset = 1;
+    while (offset < (byte_count + 1))
+    {
+        const std::uint8_t* sub_request = data + offset;
+        const std::uint16_t file_id = getHalfWord(sub_request + 1);
+        const std::uint16_t record_id = getHalfWord(sub_request + 3);
+        const size_t record_length = static_cast<size_t>(getHalfWord(sub_request + 5)) * 2;
+        const size_t start = getRecordOffset(record_id, record_size);
+        if ((offset + modbus::file_sub_request_size + record_length) > (byte_count + 1))
+        {
+            exception(function, illegal_data_value, pdu);
+            return;
+        }
+        // metadata is read only
+        if ((sub_request[0] != modbus::file_reference_type) || (file_id != static_cast<std::uint16_t>(sm::ServerFiles::application)) ||
+            ((start + record_length) > application.size()))
+        {
+            exception(function, illegal_data_address, pdu);
+            return;
+        }
+        if (getRegister(sm::ServerRegisters::file_control) != sm::file_write_prepare)
+        {
+            exception(function, server_device_failure, pdu);
+            return;
+        }
+        std::memcpy(&application[start], sub_request + modbus::file_sub_request_size, record_length);
+        last_record = last_record || (((start / record_size) + 1U) == app_size);
+        offset += modbus::file_sub_request_size + record_length;
+    }
+    if (last_record)
+    {
+        regs[static_cast<int>(sm::ServerRegisters::boot_status)] = static_cast<std::uint16_t>(sm::BootloaderStatus::ready);
+    }
+    // echo of the request
+    pdu.push_back(function);
+    pdu.insert(pdu.end(), data, data + byte_count + 1);
+}
@@ -0,0 +1,105 @@
+/**
+ * @file sm_server.hpp
+ *
+ * @brief simulated bootloader server, protocol side only, no line I/O
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#ifndef SM_SERVER_H
+#define SM_SERVER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../inc/sm_client.hpp"
+#include "../inc/sm_modbus.hpp"
+
+namespace sim
+{
+//////////////////////////////EXCEPTION CODES///////////////////////////////////
+constexpr std::uint8_t illegal_function = 0x01;
+constexpr std::uint8_t illegal_data_address = 0x02;
+constexpr std::uint8_t illegal_data_value = 0x03;
+constexpr std::uint8_t server_device_failure = 0x04;
+constexpr std::uint8_t gateway_target_failed = 0x0B;
+////////////////////////////////////////////////////////////////////////////////
+
+struct ServerConfig
+{
+    std::uint8_t addr = 1;
+    modbus::ModbusMode mode = modbus::ModbusMode::rtu;
+    std::uint16_t record_size = 64;
+    std::uint32_t available_rom = 256 * 1024;
+    std::string boot_name = "sm-simulator";
+    std::string boot_version = "1.0.0";
+};
+
+class Server
+{
+public:
+    explicit Server(const ServerConfig& config);
+    std::uint8_t getAddress() const { return addr; }
+    std::uint16_t getRegister(const sm::ServerRegisters reg) const { return regs[static_cast<int>(reg)]; }
+    /// @brief request for application file content written so far
+    /// @return application image, app_size records long
+    std::vector<std::uint8_t> getApplication() const;
+    /// @brief handle complete request addressed to this server
+    /// @param request decoded request frame: address, PDU, crc (or LRC)
+    /// @param length request frame length
+    /// @param pdu vector to save response PDU to: function code and data
+    void handleRequest(const std::uint8_t* request, const size_t length, std::vector<std::uint8_t>& pdu);
+    /// @brief check if gateway is set up to pass the response of downstream
+    /// server and account forwarded file records in gateway registers
+    /// @param request forwarded request frame: address, PDU, crc
+    /// @param response_size downstream response ADU size in bytes
+    /// @return true if response can be passed, false if it does not fit
+    /// into gateway buffer
+    bool passForwarded(const std::uint8_t* request, const size_t response_size);
+
+private:
+    std::uint8_t addr;
+    /// @brief checksum length of decoded request in actual mode
+    size_t checksum_size;
+    std::uint16_t regs[sm::amount_of_regs + sm::amount_of_ext_regs] = {};
+    /// @brief available flash, 0xFF when erased
+    std::vector<std::uint8_t> application;
+    /// @brief BootloaderInfo as it is stored in server memory
+    std::vector<std::uint8_t> metadata;
+    /// @brief create exception response
+    /// @param function request function code
+    /// @param code exception code
+    /// @param pdu vector to save response PDU to
+    static void exception(const std::uint8_t function, const std::uint8_t code, std::vector<std::uint8_t>& pdu);
+    /// @brief map register address from request to register index
+    /// @param reg register address, with or without holding registers offset
+    /// @return register index, -1 if register does not exist
+    static int getRegisterIndex(const std::uint16_t reg);
+    /// @brief write register value and apply its side effects
+    /// @param function request function code, used for exception response
+    /// @param index register index
+    /// @param value new value
+    /// @param pdu vector to save exception response to
+    /// @return true if value is stored, false if exception is created
+    bool storeRegister(const std::uint8_t function, const int index, const std::uint16_t value, std::vector<std::uint8_t>& pdu);
+    /// @return application size in records, app_size_high included
+    size_t getAppSize() const;
+    /// @brief get offset of file record selected by file_bank register
+    /// @param record_id record id from request
+    /// @param record_size record size in bytes
+    /// @return offset in file
+    size_t getRecordOffset(const std::uint16_t record_id, const size_t record_size) const;
+    /// @brief build ServerFiles::record_checksums content
+    /// @return crc16 of every application record, big-endian
+    std::vector<std::uint8_t> getRecordChecksums() const;
+    void readRegisters(const std::uint8_t* data, std::vector<std::uint8_t>& pdu);
+    void writeRegister(const std::uint8_t* data, std::vector<std::uint8_t>& pdu);
+    void writeRegisters(const std::uint8_t* data, const size_t length, std::vector<std::uint8_t>& pdu);
+    void readFile(const std::uint8_t* data, const size_t length, std::vector<std::uint8_t>& pdu);
+    void writeFile(const std::uint8_t* data, const size_t length, std::vector<std::uint8_t>& pdu);
+};
+} // namespace sim
+
+#endif // SM_SERVER_H
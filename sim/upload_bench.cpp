@@ -0,0 +1,338 @@
+/**
+ * @file upload_bench.cpp
+ *
+ * @brief firmware upload benchmark against the simulator: wall time, CPU
+ * time of the client process, records per second and bytes on the line per
+ * upload, full upload against delta upload of partially changed image
+ *
+ * @author Siarhei Tatarchanka
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "../inc/sm_client.hpp"
+
+namespace
+{
+//////////////////////////////////BENCH CONSTANTS///////////////////////////////
+constexpr std::uint8_t server_addr = 1;
+constexpr int default_image_kib = 32;
+constexpr int default_record_size = 64;
+constexpr int default_uploads = 3;
+constexpr std::uint32_t port_timeout_ms = 2000;
+////////////////////////////////////////////////////////////////////////////////
+
+struct BenchConfig
+{
+    int image_kib = default_image_kib;
+    int record_size = default_record_size;
+    int uploads = default_uploads;
+    /// @brief records changed between uploads in %, 0 to upload the same
+    /// image without delta upload
+    double changed_percent = 0.0;
+    /// @brief simulator options passed as they are
+    std::string latency_us = "0";
+    std::string baudrate;
+    bool event_mode = false;
+};
+
+struct UploadTotals
+{
+    double wall = 0;
+    double cpu = 0;
+    size_t bytes = 0;
+    int uploads = 0;
+};
+
+/// @brief simulator started as a child process, its pty is read from the
+/// first line of its output
+class SimulatorProcess
+{
+public:
+    ~SimulatorProcess() { stop(); }
+    bool start(const std::vector<std::string>& options)
+    {
+        int pipe_desc[2];
+        if (pipe(pipe_desc) != 0)
+        {
+            return false;
+        }
+        pid = fork();
+        if (pid == 0)
+        {
+            dup2(pipe_desc[1], STDOUT_FILENO);
+            close(pipe_desc[0]);
+            close(pipe_desc[1]);
+            std::vector<char*> argv;
+            argv.push_back(const_cast<char*>(SM_SIMULATOR_PATH));
+            for (const auto& option : options)
+            {
+                argv.push_back(const_cast<char*>(option.c_str()));
+            }
+            argv.push_back(nullptr);
+            execv(SM_SIMULATOR_PATH, argv.data());
+            std::_Exit(EXIT_FAILURE);
+        }
+        close(pipe_desc[1]);
+        output = fdopen(pipe_desc[0], "r");
+        char line[256] = {};
+        if ((pid < 0) || (output == nullptr) || (std::fgets(line, sizeof(line), output) == nullptr))
+        {
+            return false;
+        }
+        port = std::string(line, std::string(line).find_first_of("\r\n"));
+        return true;
+    }
+    void stop()
+    {
+        if (pid > 0)
+        {
+            kill(pid, SIGINT);
+            waitpid(pid, nullptr, 0);
+            pid = -1;
+        }
+        if (output != nullptr)
+        {
+            std::fclose(output);
+            output = nullptr;
+        }
+    }
+    const std::string& getPort() const { return port; }
+    /// @brief bytes received and sent by the simulator so far, taken from
+    /// statistics it prints on SIGUSR1
+    /// @return sum of both directions, 0 if statistics are not available
+    size_t getLineBytes()
+    {
+        if ((pid <= 0) || (kill(pid, SIGUSR1) != 0))
+        {
+            return 0;
+        }
+        char line[256] = {};
+        while (std::fgets(line, sizeof(line), output) != nullptr)
+        {
+            size_t bytes_in = 0;
+            size_t bytes_out = 0;
+            if (std::sscanf(line, "bytes in/out : %zu / %zu", &bytes_in, &bytes_out) == 2)
+            {
+                return bytes_in + bytes_out;
+            }
+        }
+        return 0;
+    }
+
+private:
+    pid_t pid = -1;
+    FILE* output = nullptr;
+    std::string port;
+};
+
+double getCpuSeconds()
+{
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+std::vector<std::uint8_t> makeImage(const size_t size)
+{
+    std::mt19937 random(1);
+    std::vector<std::uint8_t> image(size);
+    for (auto& value : image)
+    {
+        value = static_cast<std::uint8_t>(random());
+    }
+    return image;
+}
+
+/// @brief one byte changed in evenly spread records, at least one record
+void changeRecords(std::vector<std::uint8_t>& image, const size_t record_size, const double changed_percent)
+{
+    const size_t records = image.size() / record_size;
+    const size_t changed = std::max<size_t>(1, static_cast<size_t>(records * changed_percent / 100.0));
+    for (size_t i = 0; i < changed; ++i)
+    {
+        image[(i * records / changed) * record_size] ^= 0x5A;
+    }
+}
+
+bool writeImage(const std::string& path, const std::vector<std::uint8_t>& image)
+{
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    const bool written = std::fwrite(image.data(), 1, image.size(), file) == image.size();
+    std::fclose(file);
+    return written;
+}
+
+bool createImageFile(std::string& path, const std::vector<std::uint8_t>& image)
+{
+    char name[] = "/tmp/sm_upload_bench_XXXXXX";
+    const int desc = mkstemp(name);
+    if (desc < 0)
+    {
+        return false;
+    }
+    close(desc);
+    path = name;
+    return writeImage(path, image);
+}
+
+void printUsage(const char* name)
+{
+    std::fprintf(stderr,
+                 "usage: %s [options] > /dev/null\n\n"
+                 "  -s kib     image size in KiB, default %d\n"
+                 "  -r size    record size in bytes, default %d\n"
+                 "  -u count   amount of uploads, default %d\n"
+                 "  -c %%       records changed between uploads, full upload is compared\n"
+                 "             with delta upload, default 0 (the same image, full upload)\n"
+                 "  -l us      server processing latency in microseconds, default 0\n"
+                 "  -b baud    pace the line as with this baudrate, default no pacing\n"
+                 "  -e         event io mode of the port\n\n"
+                 "results are printed to stderr, client prints progress to stdout\n",
+                 name, default_image_kib, default_record_size, default_uploads);
+}
+
+bool parseArguments(int argc, char* argv[], BenchConfig& config)
+{
+    int option = 0;
+    while ((option = getopt(argc, argv, "s:r:u:c:l:b:eh")) != -1)
+    {
+        switch (option)
+        {
+            case 's':
+                config.image_kib = std::atoi(optarg);
+                break;
+            case 'r':
+                config.record_size = std::atoi(optarg);
+                break;
+            case 'u':
+                config.uploads = std::atoi(optarg);
+                break;
+            case 'c':
+                config.changed_percent = std::atof(optarg);
+                break;
+            case 'l':
+                config.latency_us = optarg;
+                break;
+            case 'b':
+                config.baudrate = optarg;
+                break;
+            case 'e':
+                config.event_mode = true;
+                break;
+            default:
+                return false;
+        }
+    }
+    return (config.image_kib > 0) && (config.record_size > 0) && ((config.record_size % 2) == 0) && (config.uploads > 0) &&
+           (config.changed_percent >= 0.0) && (config.changed_percent <= 100.0);
+}
+
+void printAverage(const char* mode, const UploadTotals& totals, const int records)
+{
+    if (totals.uploads > 0)
+    {
+        std::fprintf(stderr, "average  %-5s   %7.3f   %6.3f   %9.1f   %10zu\n", mode, totals.wall / totals.uploads, totals.cpu / totals.uploads,
+                     records * totals.uploads / totals.wall, totals.bytes / totals.uploads);
+    }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    BenchConfig config;
+    if (!parseArguments(argc, argv, config))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::vector<std::string> options = {"-d", "0", "-r", std::to_string(config.record_size), "-l", config.latency_us};
+    if (!config.baudrate.empty())
+    {
+        options.insert(options.end(), {"-b", config.baudrate});
+    }
+    SimulatorProcess simulator;
+    if (!simulator.start(options))
+    {
+        std::fprintf(stderr, "failed to start %s\n", SM_SIMULATOR_PATH);
+        return EXIT_FAILURE;
+    }
+    // images are uploaded in turn, each one differs from the image the server holds
+    const bool delta = config.changed_percent > 0.0;
+    std::vector<std::uint8_t> image = makeImage(static_cast<size_t>(config.image_kib) * 1024);
+    std::string image_paths[2];
+    bool created = createImageFile(image_paths[0], image);
+    changeRecords(image, config.record_size, config.changed_percent);
+    created = createImageFile(image_paths[1], image) && created;
+    if (!created)
+    {
+        std::fprintf(stderr, "failed to write image\n");
+        return EXIT_FAILURE;
+    }
+
+    int result = EXIT_SUCCESS;
+    {
+        sm::Client client;
+        client.addServer(server_addr);
+        sp::PortConfig port_config;
+        port_config.baudrate = sp::PortBaudRate::BD_115200;
+        port_config.timeout_ms = port_timeout_ms;
+        port_config.io_mode = config.event_mode ? sp::PortIoMode::Event : port_config.io_mode;
+        std::error_code error = client.start(simulator.getPort());
+        error = error ? error : client.configure(port_config);
+        error = error ? error : client.connect(server_addr);
+        // the server holds the first image before delta uploads are compared
+        error = (error || !delta) ? error : client.uploadApp(server_addr, image_paths[0]);
+        std::fprintf(stderr, "%d KiB image, %d byte records, %.1f%% of records changed\n\n", config.image_kib, config.record_size,
+                     config.changed_percent);
+        std::fprintf(stderr, "upload   mode    wall, s   cpu, s   records/s   line bytes   result\n");
+        const int records = config.image_kib * 1024 / config.record_size;
+        UploadTotals totals[2];
+        for (int i = 0; (i < config.uploads * (delta ? 2 : 1)) && !error; ++i)
+        {
+            const bool delta_upload = delta && ((i % 2) == 1);
+            client.setDeltaUpload(delta_upload);
+            const size_t bytes_start = simulator.getLineBytes();
+            const double cpu_start = getCpuSeconds();
+            const auto start = std::chrono::steady_clock::now();
+            error = client.uploadApp(server_addr, image_paths[delta ? ((i + 1) % 2) : 0]);
+            const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const double cpu = getCpuSeconds() - cpu_start;
+            const size_t bytes = simulator.getLineBytes() - bytes_start;
+            std::fprintf(stderr, "%6d   %-5s   %7.3f   %6.3f   %9.1f   %10zu   %s\n", i + 1, delta_upload ? "delta" : "full", wall, cpu, records / wall,
+                         bytes, error.message().c_str());
+            UploadTotals& total = totals[delta_upload ? 1 : 0];
+            total.wall += wall;
+            total.cpu += cpu;
+            total.bytes += bytes;
+            total.uploads += error ? 0 : 1;
+        }
+        std::fprintf(stderr, "\n");
+        printAverage("full", totals[0], records);
+        printAverage("delta", totals[1], records);
+        if (error)
+        {
+            std::fprintf(stderr, "failed: %s\n", error.message().c_str());
+            result = EXIT_FAILURE;
+        }
+    }
+    simulator.stop();
+    unlink(image_paths[0].c_str());
+    unlink(image_paths[1].c_str());
+    return result;
+}